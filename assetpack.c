@@ -0,0 +1,363 @@
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "assetpack.h"
+
+/* An asset pack holds many files in one, so a deployment opens a single file instead
+ * of thousands. A header is followed by the entries, each starting on a page boundary
+ * so it can be mapped in place, then by the index sorted by the hash of the names and
+ * by the names themselves. Entries may be compressed with an LZ4 style byte codec, in
+ * which case they are decompressed into anonymous memory when mapped.
+ *
+ * Once a pack is open, mapFile, stampFile, loadFile and readFiles look files up in it
+ * first and only fall back to loose files for names it does not have. */
+
+#define ASSET_PACK_MAGIC     0x4B415041
+#define ASSET_PACK_VERSION   1
+#define ASSET_PACK_ALIGNMENT 4096
+
+struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numberOfEntries;
+    uint64_t indexOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct AssetPackEntry {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size; /* as stored */
+    uint64_t originalSize;
+    int64_t modificationTime;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t compressed;
+    uint32_t padding;
+};
+
+static struct {
+    int fd;
+    uint64_t numberOfEntries;
+    struct AssetPackEntry * entries;
+    char * names;
+} pack = { .fd = -1 };
+
+static uint64_t
+hashName(const char * name, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    return hash;
+}
+
+/* Matches are at least 4 bytes long and at most 65535 bytes back. Every sequence is a
+ * token holding 4 bits of literal length and 4 bits of match length, longer lengths
+ * continuing in bytes of 255, the literals, and the 2 byte offset of the match. The
+ * last sequence has literals only. */
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS  16
+
+static size_t
+maxCompressedSize(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static size_t
+writeLength(unsigned char * out, size_t length) {
+    size_t written = 0;
+    for (; 255 <= length; length -= 255) out[written++] = 255;
+    out[written++] = length;
+    return written;
+}
+
+static size_t
+writeSequence(unsigned char * out, const unsigned char * literals, size_t numberOfLiterals,
+        size_t offset, size_t matchLength) {
+    size_t written = 1;
+    size_t literalsToken = numberOfLiterals < 15 ? numberOfLiterals : 15;
+    size_t matchToken = 0;
+    if (matchLength) {
+        matchLength -= LZ_MIN_MATCH;
+        matchToken = matchLength < 15 ? matchLength : 15;
+    }
+    out[0] = literalsToken << 4 | matchToken;
+    if (15 == literalsToken) written += writeLength(out + written, numberOfLiterals - 15);
+    memcpy(out + written, literals, numberOfLiterals);
+    written += numberOfLiterals;
+    if (offset) {
+        out[written++] = offset & 255;
+        out[written++] = offset >> 8;
+        if (15 == matchToken) written += writeLength(out + written, matchLength - 15);
+    }
+    return written;
+}
+
+static size_t
+compressLz(unsigned char * out, const unsigned char * in, size_t size) {
+    uint32_t * table = emalloc(sizeof(uint32_t) << LZ_HASH_BITS);
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+    size_t written = 0, anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= size) {
+        uint32_t sequence;
+        memcpy(&sequence, in + i, sizeof(sequence));
+        uint32_t bucket = (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[bucket];
+        table[bucket] = i + 1;
+        if (!candidate || LZ_MAX_OFFSET < i + 1 - candidate
+                || memcmp(in + candidate - 1, in + i, LZ_MIN_MATCH)) {
+            ++i;
+            continue;
+        }
+        size_t match = candidate - 1, length = LZ_MIN_MATCH;
+        while (i + length < size && in[match + length] == in[i + length]) ++length;
+        written += writeSequence(out + written, in + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+    written += writeSequence(out + written, in + anchor, size - anchor, 0, 0);
+    free(table);
+    return written;
+}
+
+static int
+readLength(const unsigned char ** in, const unsigned char * end, size_t * length) {
+    unsigned char byte;
+    do {
+        if (*in == end) return 1;
+        byte = *(*in)++;
+        *length += byte;
+    } while (255 == byte);
+    return 0;
+}
+
+/* Returns nonzero if in does not decompress to exactly size bytes. */
+static int
+decompressLz(unsigned char * out, size_t size, const unsigned char * in, size_t inSize) {
+    const unsigned char * end = in + inSize;
+    size_t written = 0;
+    while (in < end) {
+        unsigned token = *in++;
+        size_t length = token >> 4;
+        if (15 == length && readLength(&in, end, &length)) return 1;
+        if ((size_t)(end - in) < length || size - written < length) return 1;
+        memcpy(out + written, in, length);
+        in += length;
+        written += length;
+        if (in == end) break;
+        if (end - in < 2) return 1;
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        length = token & 15;
+        if (15 == length && readLength(&in, end, &length)) return 1;
+        length += LZ_MIN_MATCH;
+        if (!offset || written < offset || size - written < length) return 1;
+        for (size_t i = 0; i < length; ++i, ++written) out[written] = out[written - offset];
+    }
+    return written != size;
+}
+
+/* Returns nonzero if there is no valid pack at filepath, in which case only loose
+ * files are used. */
+extern int
+openAssetPack(const char * filepath) {
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 1;
+    struct AssetPackHeader header;
+    struct stat status;
+    int valid = !fstat(fd, &status)
+        && sizeof(header) == pread(fd, &header, sizeof(header), 0)
+        && ASSET_PACK_MAGIC == header.magic && ASSET_PACK_VERSION == header.version
+        && header.indexOffset <= (uint64_t)status.st_size
+        && header.numberOfEntries
+            <= (status.st_size - header.indexOffset) / sizeof(struct AssetPackEntry)
+        && header.namesOffset <= (uint64_t)status.st_size
+        && header.namesSize <= status.st_size - header.namesOffset;
+    if (!valid) {
+        close(fd);
+        return 1;
+    }
+    size_t indexSize = header.numberOfEntries * sizeof(struct AssetPackEntry);
+    struct AssetPackEntry * entries = emalloc(indexSize + 1);
+    char * names = emalloc(header.namesSize + 1);
+    valid = (ssize_t)indexSize == pread(fd, entries, indexSize, header.indexOffset)
+        && (ssize_t)header.namesSize == pread(fd, names, header.namesSize, header.namesOffset);
+    for (uint64_t i = 0; valid && i < header.numberOfEntries; ++i) {
+        struct AssetPackEntry * entry = &entries[i];
+        valid = entry->nameOffset <= header.namesSize
+            && entry->nameLength <= header.namesSize - entry->nameOffset
+            && entry->offset <= (uint64_t)status.st_size
+            && entry->size <= status.st_size - entry->offset
+            && (entry->compressed || entry->size == entry->originalSize)
+            && (!i || entries[i - 1].hash <= entry->hash);
+    }
+    if (!valid) {
+        free(entries);
+        free(names);
+        close(fd);
+        return 1;
+    }
+    if (0 <= pack.fd) close(pack.fd);
+    free(pack.entries);
+    free(pack.names);
+    pack.fd = fd;
+    pack.numberOfEntries = header.numberOfEntries;
+    pack.entries = entries;
+    pack.names = names;
+    return 0;
+}
+
+static struct AssetPackEntry *
+findPackedFile(const char * filepath) {
+    if (pack.fd < 0) return NULL;
+    size_t length = strlen(filepath);
+    uint64_t hash = hashName(filepath, length);
+    uint64_t first = 0, last = pack.numberOfEntries;
+    while (first < last) {
+        uint64_t middle = first + (last - first) / 2;
+        if (pack.entries[middle].hash < hash) first = middle + 1;
+        else last = middle;
+    }
+    for (; first < pack.numberOfEntries && hash == pack.entries[first].hash; ++first) {
+        struct AssetPackEntry * entry = &pack.entries[first];
+        if (length == entry->nameLength
+                && !memcmp(filepath, pack.names + entry->nameOffset, length)) return entry;
+    }
+    return NULL;
+}
+
+/* Maps a packed file just like mapFile maps a loose one. Stored entries that start on 
+ * a page boundary have their whole pages mapped in place. Whatever follows an entry in
+ * the pack would show through the rest of its last page, so that page is read into 
+ * anonymous memory instead, which keeps the zero byte after the file. Returns NULL if
+ * the file is not packed. */
+extern char *
+mapPackedFile(const char * filepath, size_t * mappingSize) {
+    struct AssetPackEntry * entry = findPackedFile(filepath);
+    if (!entry) return NULL;
+    size_t size = entry->originalSize;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    *mappingSize = (size / pageSize + 1) * pageSize;
+    int inPlace = !entry->compressed && !(entry->offset % pageSize);
+    size_t mappedSize = inPlace ? size - size % pageSize : 0;
+    char * mapping = mmap(NULL, *mappingSize, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mapping) exit(1);
+    if (mappedSize && MAP_FAILED == mmap(mapping, mappedSize, PROT_READ, 
+                MAP_PRIVATE | MAP_FIXED, pack.fd, entry->offset)) exit(1);
+    char * stored = entry->compressed ? emalloc(entry->size) : mapping;
+    for (size_t offset = mappedSize; offset < entry->size;) {
+        ssize_t read = pread(pack.fd, stored + offset, entry->size - offset,
+            entry->offset + offset);
+        if (read <= 0) exit(1);
+        offset += read;
+    }
+    if (entry->compressed) {
+        if (decompressLz((unsigned char *)mapping, size, (unsigned char *)stored, entry->size)) {
+            exit(1);
+        }
+        free(stored);
+    }
+    mprotect(mapping + mappedSize, *mappingSize - mappedSize, PROT_READ);
+    return mapping;
+}
+
+/* Packed files carry the size and modification time the loose file had when it was
+ * packed. Returns nonzero if the file is not packed. */
+extern int
+stampPackedFile(const char * filepath, struct FileStamp * stamp) {
+    struct AssetPackEntry * entry = findPackedFile(filepath);
+    if (!entry) return 1;
+    stamp->size = entry->originalSize;
+    stamp->modificationTime = entry->modificationTime;
+    return 0;
+}
+
+static int
+compareEntries(const void * a, const void * b) {
+    const struct AssetPackEntry * x = a, * y = b;
+    return x->hash < y->hash ? -1 : y->hash < x->hash;
+}
+
+/* Packs loose files under their paths as given. With compress set, entries that
+ * shrink by at least an eighth are stored compressed. Returns nonzero on failure. */
+extern int
+writeAssetPack(const char * filepath, char ** files, unsigned long count, int compress) {
+    char * temporaryPath = pathWithSuffix(filepath, ".tmp");
+    FILE * out = fopen(temporaryPath, "wb");
+    if (!out) {
+        free(temporaryPath);
+        return 1;
+    }
+    struct AssetPackHeader header = { .magic = 0 };
+    struct AssetPackEntry * entries = emalloc((count + 1) * sizeof(struct AssetPackEntry));
+    int failed = 1 != fwrite(&header, sizeof(header), 1, out);
+    uint64_t offset = sizeof(header), namesSize = 0;
+    static const char zeros[ASSET_PACK_ALIGNMENT];
+    for (unsigned long i = 0; i < count; ++i) {
+        struct AssetPackEntry * entry = &entries[i];
+        struct stat status;
+        if (stat(files[i], &status)) exit(1);
+        size_t mappingSize;
+        char * content = mapFile(files[i], &mappingSize);
+        size_t padding = (ASSET_PACK_ALIGNMENT - offset % ASSET_PACK_ALIGNMENT)
+            % ASSET_PACK_ALIGNMENT;
+        failed |= padding != fwrite(zeros, 1, padding, out);
+        offset += padding;
+        memset(entry, 0, sizeof(*entry));
+        entry->nameLength = strlen(files[i]);
+        entry->hash = hashName(files[i], entry->nameLength);
+        entry->nameOffset = namesSize;
+        entry->offset = offset;
+        entry->originalSize = status.st_size;
+        entry->modificationTime = status.st_mtime;
+        entry->size = entry->originalSize;
+        namesSize += entry->nameLength;
+        unsigned char * compressed = NULL;
+        if (compress) {
+            compressed = emalloc(maxCompressedSize(entry->originalSize));
+            size_t size = compressLz(compressed, (unsigned char *)content, entry->originalSize);
+            if (size <= entry->originalSize - entry->originalSize / 8) {
+                entry->size = size;
+                entry->compressed = 1;
+            }
+        }
+        char * stored = entry->compressed ? (char *)compressed : content;
+        failed |= entry->size != fwrite(stored, 1, entry->size, out);
+        offset += entry->size;
+        free(compressed);
+        unmapFile(content, mappingSize);
+    }
+    qsort(entries, count, sizeof(struct AssetPackEntry), compareEntries);
+    header.magic           = ASSET_PACK_MAGIC;
+    header.version         = ASSET_PACK_VERSION;
+    header.numberOfEntries = count;
+    header.indexOffset     = offset + (sizeof(uint64_t) - offset % sizeof(uint64_t))
+        % sizeof(uint64_t);
+    header.namesOffset     = header.indexOffset + count * sizeof(struct AssetPackEntry);
+    header.namesSize       = namesSize;
+    failed |= header.indexOffset - offset != fwrite(zeros, 1, header.indexOffset - offset, out);
+    failed |= count != fwrite(entries, sizeof(struct AssetPackEntry), count, out);
+    for (unsigned long i = 0; i < count; ++i) {
+        size_t length = strlen(files[i]);
+        failed |= length != fwrite(files[i], 1, length, out);
+    }
+    failed |= fseek(out, 0, SEEK_SET);
+    failed |= 1 != fwrite(&header, sizeof(header), 1, out);
+    failed |= fclose(out);
+    failed |= rename(temporaryPath, filepath);
+    if (failed) remove(temporaryPath);
+    free(temporaryPath);
+    free(entries);
+    return failed;
+}
@@ -0,0 +1,5 @@
+extern int openAssetPack(const char * filepath);
+extern char * mapPackedFile(const char * filepath, size_t * mappingSize);
+extern int stampPackedFile(const char * filepath, struct FileStamp * stamp);
+extern int writeAssetPack(const char * filepath, char ** files, unsigned long count,
+    int compress);
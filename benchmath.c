@@ -0,0 +1,527 @@
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include "cpu.h"
+#include "geometry.h"
+
+/* bench_math [rounds]
+ *
+ * Checks every public function of geometry.c against the scalar reference, then times
+ * it as single calls on the same operands, over a batch that stays in cache and over a
+ * large one that does not. The functions that run bound kernels are checked and timed
+ * again at every CPU level below that of the machine. Each figure is the mean of
+ * SAMPLES samples of at least rounds * BATCH operations, with its 95% confidence
+ * interval, and timestamp counter ticks per operation, which count at the nominal clock
+ * rate rather than the core one. Last comes the time cullSpheres takes for a frame of
+ * FRAME_OBJECTS objects on all processors, against its budget of FRAME_BUDGET. */
+
+#define BATCH 1024
+#define LARGE_BATCH (1 << 18)
+#define FRAME_OBJECTS (1 << 20)
+#define FRAME_BUDGET 1e6 /* ns */
+#define SAMPLES 20
+/* Student's t for a 95% interval with SAMPLES - 1 degrees of freedom */
+#define T_95 2.093
+
+static Mat4 * as;
+static Mat4 * bs;
+static Mat4 * transforms;      /* T R S of the components below */
+static enum TransformKind * kinds;
+static Mat4 * outs;
+static Mat3 * normals;
+static GLfloat (*vectors)[4];
+static GLfloat (*translations)[3];
+static GLfloat (*angles)[3];
+static GLfloat (*rotations)[4]; /* the quaternions of angles */
+static GLfloat (*scales)[3];
+static struct TransformArrays objects;
+static struct BoundingSpheres spheres;
+static GLuint * visible;
+static Mat4 perspective;
+static struct Frustum frustum;
+
+static double
+now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/* 0 where there is no timestamp counter */
+static unsigned long long
+readTimestamp(void) {
+#ifdef CPU_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static GLfloat
+randomIn(GLfloat low, GLfloat high) {
+    return low + rand() / (GLfloat)RAND_MAX * (high - low);
+}
+
+static void *
+allocate(size_t size) {
+    void * p = malloc(size);
+    if (!p) exit(1);
+    return p;
+}
+
+/* The scale is 1 for a third of the transforms, uniform for another and free for the
+ * rest, so every kind is represented. */
+static void
+initOperands(void) {
+    as = allocate(LARGE_BATCH * sizeof(Mat4));
+    bs = allocate(LARGE_BATCH * sizeof(Mat4));
+    transforms = allocate(LARGE_BATCH * sizeof(Mat4));
+    kinds = allocate(LARGE_BATCH * sizeof(enum TransformKind));
+    outs = allocate(LARGE_BATCH * sizeof(Mat4));
+    normals = allocate(LARGE_BATCH * sizeof(Mat3));
+    vectors = allocate(LARGE_BATCH * sizeof(*vectors));
+    translations = allocate(LARGE_BATCH * sizeof(*translations));
+    angles = allocate(LARGE_BATCH * sizeof(*angles));
+    rotations = allocate(LARGE_BATCH * sizeof(*rotations));
+    scales = allocate(LARGE_BATCH * sizeof(*scales));
+    GLfloat * components = allocate(9 * LARGE_BATCH * sizeof(GLfloat));
+    GLfloat * sphereComponents = allocate(4 * FRAME_OBJECTS * sizeof(GLfloat));
+    visible = allocate(FRAME_OBJECTS * sizeof(GLuint));
+    srand(1);
+    for (unsigned long i = 0; i < LARGE_BATCH; ++i) {
+        for (int j = 0; j < 16; ++j) {
+            as[i].m[j] = randomIn(-1, 1);
+            bs[i].m[j] = randomIn(-1, 1);
+        }
+        GLfloat uniform = randomIn(0.5, 2);
+        for (int j = 0; j < 3; ++j) {
+            vectors[i][j] = randomIn(-1, 1);
+            translations[i][j] = randomIn(-10, 10);
+            angles[i][j] = randomIn(-M_PI, M_PI);
+            scales[i][j] = i % 3 ? (1 == i % 3 ? uniform : randomIn(0.5, 2)) : 1;
+            components[j * LARGE_BATCH + i] = translations[i][j];
+            components[(3 + j) * LARGE_BATCH + i] = angles[i][j];
+            components[(6 + j) * LARGE_BATCH + i] = scales[i][j];
+        }
+        vectors[i][3] = 1;
+        GLfloat sx = sinf(angles[i][0] / 2), cx = cosf(angles[i][0] / 2);
+        GLfloat sy = sinf(angles[i][1] / 2), cy = cosf(angles[i][1] / 2);
+        GLfloat sz = sinf(angles[i][2] / 2), cz = cosf(angles[i][2] / 2);
+        rotations[i][0] = sx * cy * cz - cx * sy * sz;
+        rotations[i][1] = cx * sy * cz + sx * cy * sz;
+        rotations[i][2] = cx * cy * sz - sx * sy * cz;
+        rotations[i][3] = cx * cy * cz + sx * sy * sz;
+        kinds[i] = mat4OfTrs(&transforms[i], translations[i], angles[i], scales[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        objects.translation[i] = components + i * LARGE_BATCH;
+        objects.angles[i] = components + (3 + i) * LARGE_BATCH;
+        objects.scale[i] = components + (6 + i) * LARGE_BATCH;
+    }
+    for (unsigned long i = 0; i < FRAME_OBJECTS; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            sphereComponents[j * FRAME_OBJECTS + i] = randomIn(-100, 100);
+        }
+        sphereComponents[3 * FRAME_OBJECTS + i] = randomIn(0.1, 2);
+    }
+    spheres.count = FRAME_OBJECTS;
+    for (int i = 0; i < 3; ++i) spheres.center[i] = sphereComponents + i * FRAME_OBJECTS;
+    spheres.radius = sphereComponents + 3 * FRAME_OBJECTS;
+    mat4OfPerspective(&perspective, -1, 1, -1, 1, 1, 100);
+    frustumOfMatrix(&frustum, &perspective);
+}
+
+/* Legacy order of the scalar code: row i of out is row i of the matrix dotted with v. */
+static void
+transformVectorRows(GLfloat * out, GLfloat * matrix, GLfloat * vector) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = 0;
+        for (int j = 0; j < 4; ++j) out[i] += matrix[i * 4 + j] * vector[j];
+    }
+}
+
+/* Counts the elements of a further than tolerance from those of b, relative to them. A
+ * tolerance of 0 still lets the sign of zero differ. */
+static int
+disagreements(const GLfloat * a, const GLfloat * b, int n, GLfloat tolerance) {
+    int failures = 0;
+    for (int i = 0; i < n; ++i) {
+        failures += !(fabsf(a[i] - b[i]) <= tolerance * (1 + fabsf(b[i])));
+    }
+    return failures;
+}
+
+/* Storage order aside, the Mat4 results must match the row major legacy ones. */
+static void
+toRows(GLfloat * rows, const Mat4 * matrix) {
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) rows[i * 4 + j] = MAT4_AT(matrix, i, j);
+    }
+}
+
+static int
+expect(const char * name, int failures) {
+    if (failures) {
+        printf("%-24s %d results disagree with the scalar reference\n", name, failures);
+    }
+    return failures;
+}
+
+/* Compares a builder to its legacy version */
+static int
+expectRows(const char * name, const GLfloat * expected, const Mat4 * matrix) {
+    GLfloat actual[16];
+    toRows(actual, matrix);
+    return expect(name, disagreements(actual, expected, 16, 0));
+}
+
+/* Compares a product of known structure to the full one */
+static int
+expectProduct(const char * name, const Mat4 * actual, const Mat4 * a, const Mat4 * b) {
+    Mat4 product;
+    mat4Multiply(&product, a, b);
+    return expect(name, disagreements(actual->m, product.m, 16, 0));
+}
+
+static int
+checkBuilders(void) {
+    int failures = 0;
+    for (int i = 0; i < BATCH; ++i) {
+        GLfloat expected[16];
+        GLfloat * s = scales[i], * t = translations[i], * r = angles[i];
+        Mat4 out, factor;
+        matrixOfPerspective(expected, -s[0], s[1], -s[2], t[0], 1, 10 + s[0]);
+        mat4OfPerspective(&out, -s[0], s[1], -s[2], t[0], 1, 10 + s[0]);
+        failures += expectRows("mat4OfPerspective", expected, &out);
+        matrixOfIdentity(expected);
+        mat4OfIdentity(&out);
+        failures += expectRows("mat4OfIdentity", expected, &out);
+        matrixOfScale(expected, s[0], s[1], s[2]);
+        mat4OfScale(&out, s[0], s[1], s[2]);
+        failures += expectRows("mat4OfScale", expected, &out);
+        matrixOfTranslation(expected, t[0], t[1], t[2]);
+        mat4OfTranslation(&out, t[0], t[1], t[2]);
+        failures += expectRows("mat4OfTranslation", expected, &out);
+        matrixOfRotationX(expected, r[0]);
+        mat4OfRotationX(&out, r[0]);
+        failures += expectRows("mat4OfRotationX", expected, &out);
+        matrixOfRotationY(expected, r[1]);
+        mat4OfRotationY(&out, r[1]);
+        failures += expectRows("mat4OfRotationY", expected, &out);
+        matrixOfRotationZ(expected, r[2]);
+        mat4OfRotationZ(&out, r[2]);
+        failures += expectRows("mat4OfRotationZ", expected, &out);
+        /* T Rz Ry Rx S */
+        Mat4 trs;
+        mat4OfTranslation(&trs, t[0], t[1], t[2]);
+        mat4RotateZ(&trs, r[2]);
+        mat4RotateY(&trs, r[1]);
+        mat4RotateX(&trs, r[0]);
+        mat4Scale(&trs, s[0], s[1], s[2]);
+        mat4OfTrs(&out, t, r, s);
+        failures += expect("mat4OfTrs", disagreements(out.m, trs.m, 16, 1e-5));
+        mat4OfTrsQuaternion(&out, t, rotations[i], s);
+        failures += expect("mat4OfTrsQuaternion", disagreements(out.m, trs.m, 16, 1e-5));
+        out = as[i];
+        mat4Translate(&out, t[0], t[1], t[2]);
+        mat4OfTranslation(&factor, t[0], t[1], t[2]);
+        failures += expectProduct("mat4Translate", &out, &as[i], &factor);
+        out = as[i];
+        mat4Scale(&out, s[0], s[1], s[2]);
+        mat4OfScale(&factor, s[0], s[1], s[2]);
+        failures += expectProduct("mat4Scale", &out, &as[i], &factor);
+        out = as[i];
+        mat4RotateX(&out, r[0]);
+        mat4OfRotationX(&factor, r[0]);
+        failures += expectProduct("mat4RotateX", &out, &as[i], &factor);
+        out = as[i];
+        mat4RotateY(&out, r[1]);
+        mat4OfRotationY(&factor, r[1]);
+        failures += expectProduct("mat4RotateY", &out, &as[i], &factor);
+        out = as[i];
+        mat4RotateZ(&out, r[2]);
+        mat4OfRotationZ(&factor, r[2]);
+        failures += expectProduct("mat4RotateZ", &out, &as[i], &factor);
+        mat4MultiplyPerspective(&out, &perspective, &as[i]);
+        failures += expectProduct("mat4MultiplyPerspective", &out, &perspective, &as[i]);
+    }
+    return failures;
+}
+
+/* Checks the functions that run kernels bound by bindGeometryKernels, and those built on
+ * them. */
+static int
+checkKernels(void) {
+    int failures = 0;
+    for (int i = 0; i < BATCH; ++i) {
+        GLfloat a[16], b[16], expected[16];
+        toRows(a, &as[i]);
+        toRows(b, &bs[i]);
+        Mat4 out, inverse;
+        matrixMultiplymm(expected, a, b);
+        mat4Multiply(&out, &as[i], &bs[i]);
+        failures += expectRows("mat4Multiply", expected, &out);
+        matrixTranspose(expected, a);
+        mat4Transpose(&out, &as[i]);
+        failures += expectRows("mat4Transpose", expected, &out);
+        if (!matrixInverse(expected, a) && !mat4Inverse(&out, &as[i])) {
+            GLfloat actual[16];
+            toRows(actual, &out);
+            failures += expect("mat4Inverse", disagreements(actual, expected, 16, 1e-3));
+        }
+        GLfloat vector[4];
+        transformVectorRows(expected, a, vectors[i]);
+        mat4TransformVectors(vector, &as[i], vectors[i], 1);
+        failures += expect("mat4TransformVectors", disagreements(vector, expected, 4, 1e-5));
+        const Mat4 * next = &transforms[(i + 1) % BATCH];
+        mat4MultiplyAffine(&out, &transforms[i], next);
+        failures += expectProduct("mat4MultiplyAffine", &out, &transforms[i], next);
+        mat4Inverse(&inverse, &transforms[i]);
+        mat4InverseOfKind(&out, &transforms[i], kinds[i]);
+        failures += expect("mat4InverseOfKind", disagreements(out.m, inverse.m, 16, 1e-4));
+        Mat3 normal, transposedInverse;
+        mat4NormalMatrix(&normal, &transforms[i], kinds[i]);
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k) {
+                MAT3_AT(&transposedInverse, j, k) = MAT4_AT(&inverse, k, j);
+            }
+        }
+        failures += expect("mat4NormalMatrix",
+            disagreements(normal.m, transposedInverse.m, 9, 1e-4));
+    }
+    struct TransformArrays batch = objects;
+    batch.count = BATCH;
+    composeTransforms(outs, normals, &transforms[0], &batch);
+    for (int i = 0; i < BATCH; ++i) {
+        Mat4 modelView;
+        Mat3 normal;
+        mat4OfTrs(&modelView, translations[i], angles[i], scales[i]);
+        mat4Multiply(&modelView, &transforms[0], &modelView);
+        mat4NormalMatrix(&normal, &modelView, TRANSFORM_AFFINE);
+        failures += expect("composeTransforms", 
+            disagreements(outs[i].m, modelView.m, 16, 1e-4)
+            + disagreements(normals[i].m, normal.m, 9, 1e-3));
+    }
+    unsigned long numberOfVisible = cullSpheres(visible, &frustum, &spheres);
+    unsigned long expected = 0;
+    int culling = 0;
+    for (unsigned long i = 0; i < spheres.count; ++i) {
+        int reaches = 1;
+        for (int p = 0; p < 6; ++p) {
+            const GLfloat * plane = frustum.planes[p];
+            GLfloat distance = plane[0] * spheres.center[0][i] 
+                + plane[1] * spheres.center[1][i] + plane[2] * spheres.center[2][i];
+            if (distance + plane[3] + spheres.radius[i] < 0) reaches = 0;
+        }
+        if (!reaches) continue;
+        culling += expected >= numberOfVisible || i != visible[expected];
+        ++expected;
+    }
+    failures += expect("cullSpheres", culling + (expected != numberOfVisible));
+    return failures;
+}
+
+/* A benchmark runs count operations on the operands at index i * stride, so a stride of 0
+ * repeats a single call on the same operands. */
+struct Benchmark {
+    const char * name;
+    void (*run)(unsigned long count, unsigned long stride);
+    int kernel; /* runs kernels bound by bindGeometryKernels */
+};
+
+#define BENCHMARK(name, operation) \
+    static void \
+    name(unsigned long count, unsigned long stride) { \
+        for (unsigned long i = 0, k = 0; i < count; ++i, k += stride) operation; \
+    }
+
+BENCHMARK(benchMatrixOfPerspective,
+    matrixOfPerspective(outs[k].m, -1, 1, -1, 1, 1, 10 + scales[k][0]))
+BENCHMARK(benchMatrixOfIdentity, matrixOfIdentity(outs[k].m))
+BENCHMARK(benchMatrixOfScale,
+    matrixOfScale(outs[k].m, scales[k][0], scales[k][1], scales[k][2]))
+BENCHMARK(benchMatrixOfTranslation, 
+    matrixOfTranslation(outs[k].m, translations[k][0], translations[k][1], 
+        translations[k][2]))
+BENCHMARK(benchMatrixOfRotationX, matrixOfRotationX(outs[k].m, angles[k][0]))
+BENCHMARK(benchMatrixOfRotationY, matrixOfRotationY(outs[k].m, angles[k][1]))
+BENCHMARK(benchMatrixOfRotationZ, matrixOfRotationZ(outs[k].m, angles[k][2]))
+BENCHMARK(benchMatrixMultiplymm, matrixMultiplymm(outs[k].m, as[k].m, bs[k].m))
+BENCHMARK(benchMatrixTranspose, matrixTranspose(outs[k].m, as[k].m))
+BENCHMARK(benchMatrixInverse, matrixInverse(outs[k].m, as[k].m))
+BENCHMARK(benchMat4OfPerspective,
+    mat4OfPerspective(&outs[k], -1, 1, -1, 1, 1, 10 + scales[k][0]))
+BENCHMARK(benchMat4OfIdentity, mat4OfIdentity(&outs[k]))
+BENCHMARK(benchMat4OfScale, mat4OfScale(&outs[k], scales[k][0], scales[k][1], scales[k][2]))
+BENCHMARK(benchMat4OfTranslation,
+    mat4OfTranslation(&outs[k], translations[k][0], translations[k][1], translations[k][2]))
+BENCHMARK(benchMat4OfRotationX, mat4OfRotationX(&outs[k], angles[k][0]))
+BENCHMARK(benchMat4OfRotationY, mat4OfRotationY(&outs[k], angles[k][1]))
+BENCHMARK(benchMat4OfRotationZ, mat4OfRotationZ(&outs[k], angles[k][2]))
+BENCHMARK(benchMat4OfTrs, mat4OfTrs(&outs[k], translations[k], angles[k], scales[k]))
+BENCHMARK(benchMat4OfTrsQuaternion,
+    mat4OfTrsQuaternion(&outs[k], translations[k], rotations[k], scales[k]))
+BENCHMARK(benchMat4Translate,
+    mat4Translate(&outs[k], translations[k][0], translations[k][1], translations[k][2]))
+BENCHMARK(benchMat4Scale, mat4Scale(&outs[k], scales[k][0], scales[k][1], scales[k][2]))
+BENCHMARK(benchMat4RotateX, mat4RotateX(&outs[k], angles[k][0]))
+BENCHMARK(benchMat4RotateY, mat4RotateY(&outs[k], angles[k][1]))
+BENCHMARK(benchMat4RotateZ, mat4RotateZ(&outs[k], angles[k][2]))
+BENCHMARK(benchMat4MultiplyPerspective,
+    mat4MultiplyPerspective(&outs[k], &perspective, &as[k]))
+BENCHMARK(benchMat4InverseOfKind, mat4InverseOfKind(&outs[k], &transforms[k], kinds[k]))
+BENCHMARK(benchMat4NormalMatrix, mat4NormalMatrix(&normals[k], &transforms[k], kinds[k]))
+BENCHMARK(benchMat4Multiply, mat4Multiply(&outs[k], &as[k], &bs[k]))
+BENCHMARK(benchMat4MultiplyAffine,
+    mat4MultiplyAffine(&outs[k], &transforms[k], &transforms[0]))
+BENCHMARK(benchMat4Transpose, mat4Transpose(&outs[k], &as[k]))
+BENCHMARK(benchMat4Inverse, mat4Inverse(&outs[k], &as[k]))
+
+/* The batch functions take a whole batch in one call, or one element per call. */
+static void
+benchMat4TransformVectors(unsigned long count, unsigned long stride) {
+    if (stride) {
+        mat4TransformVectors(outs[0].m, &as[0], vectors[0], count);
+        return;
+    }
+    for (unsigned long i = 0; i < count; ++i) {
+        mat4TransformVectors(outs[0].m, &as[0], vectors[0], 1);
+    }
+}
+
+static void
+benchComposeTransforms(unsigned long count, unsigned long stride) {
+    struct TransformArrays batch = objects;
+    batch.count = stride ? count : 1;
+    for (unsigned long i = 0; i < (stride ? 1 : count); ++i) {
+        composeTransforms(outs, normals, &transforms[0], &batch);
+    }
+}
+
+static void
+benchCullSpheres(unsigned long count, unsigned long stride) {
+    struct BoundingSpheres batch = spheres;
+    batch.count = stride ? count : 1;
+    for (unsigned long i = 0; i < (stride ? 1 : count); ++i) {
+        cullSpheres(visible, &frustum, &batch);
+    }
+}
+
+static const struct Benchmark benchmarks[] = {
+    { "matrixOfPerspective",     benchMatrixOfPerspective,     0 },
+    { "matrixOfIdentity",        benchMatrixOfIdentity,        0 },
+    { "matrixOfScale",           benchMatrixOfScale,           0 },
+    { "matrixOfTranslation",     benchMatrixOfTranslation,     0 },
+    { "matrixOfRotationX",       benchMatrixOfRotationX,       0 },
+    { "matrixOfRotationY",       benchMatrixOfRotationY,       0 },
+    { "matrixOfRotationZ",       benchMatrixOfRotationZ,       0 },
+    { "matrixMultiplymm",        benchMatrixMultiplymm,        0 },
+    { "matrixTranspose",         benchMatrixTranspose,         0 },
+    { "matrixInverse",           benchMatrixInverse,           0 },
+    { "mat4OfPerspective",       benchMat4OfPerspective,       0 },
+    { "mat4OfIdentity",          benchMat4OfIdentity,          0 },
+    { "mat4OfScale",             benchMat4OfScale,             0 },
+    { "mat4OfTranslation",       benchMat4OfTranslation,       0 },
+    { "mat4OfRotationX",         benchMat4OfRotationX,         0 },
+    { "mat4OfRotationY",         benchMat4OfRotationY,         0 },
+    { "mat4OfRotationZ",         benchMat4OfRotationZ,         0 },
+    { "mat4OfTrs",               benchMat4OfTrs,               0 },
+    { "mat4OfTrsQuaternion",     benchMat4OfTrsQuaternion,     0 },
+    { "mat4Translate",           benchMat4Translate,           0 },
+    { "mat4Scale",               benchMat4Scale,               0 },
+    { "mat4RotateX",             benchMat4RotateX,             0 },
+    { "mat4RotateY",             benchMat4RotateY,             0 },
+    { "mat4RotateZ",             benchMat4RotateZ,             0 },
+    { "mat4MultiplyPerspective", benchMat4MultiplyPerspective, 0 },
+    { "mat4InverseOfKind",       benchMat4InverseOfKind,       0 },
+    { "mat4NormalMatrix",        benchMat4NormalMatrix,        0 },
+    { "mat4Multiply",            benchMat4Multiply,            1 },
+    { "mat4MultiplyAffine",      benchMat4MultiplyAffine,      1 },
+    { "mat4Transpose",           benchMat4Transpose,           1 },
+    { "mat4Inverse",             benchMat4Inverse,             1 },
+    { "mat4TransformVectors",    benchMat4TransformVectors,    1 },
+    { "composeTransforms",       benchComposeTransforms,       1 },
+    { "cullSpheres",             benchCullSpheres,             1 },
+};
+
+static const struct Benchmark frameCulling = { "cullSpheres", benchCullSpheres, 1 };
+
+struct Timing {
+    double nanoseconds; /* per operation, the mean of the samples */
+    double interval;    /* half the width of its 95% confidence interval */
+    double ticks;       /* of the timestamp counter per operation */
+};
+
+/* The first run is not timed, it faults in the pages of the operands. */
+static struct Timing
+measure(const struct Benchmark * benchmark, unsigned long count, unsigned long stride,
+        unsigned long repeats) {
+    double samples[SAMPLES], sum = 0, squares = 0, ticks = 0;
+    double operations = (double)count * repeats;
+    benchmark->run(count, stride);
+    for (int s = 0; s < SAMPLES; ++s) {
+        unsigned long long startTicks = readTimestamp();
+        double start = now();
+        for (unsigned long r = 0; r < repeats; ++r) benchmark->run(count, stride);
+        samples[s] = (now() - start) / operations;
+        ticks += (readTimestamp() - startTicks) / operations;
+        sum += samples[s];
+    }
+    struct Timing timing = { .nanoseconds = sum / SAMPLES, .ticks = ticks / SAMPLES };
+    for (int s = 0; s < SAMPLES; ++s) {
+        squares += (samples[s] - timing.nanoseconds) * (samples[s] - timing.nanoseconds);
+    }
+    timing.interval = T_95 * sqrt(squares / (SAMPLES - 1) / SAMPLES);
+    return timing;
+}
+
+static void
+report(const char * name, const char * mode, struct Timing timing) {
+    printf("%-24s %-6s %9.2f +- %6.2f ns/op %9.1f ticks/op\n", name, mode,
+        timing.nanoseconds, timing.interval, timing.ticks);
+}
+
+static void
+runBenchmark(const struct Benchmark * benchmark, unsigned long rounds) {
+    unsigned long largeRepeats = rounds * BATCH / LARGE_BATCH;
+    report(benchmark->name, "single", measure(benchmark, BATCH, 0, rounds));
+    report(benchmark->name, "batch", measure(benchmark, BATCH, 1, rounds));
+    report(benchmark->name, "large",
+        measure(benchmark, LARGE_BATCH, 1, largeRepeats ? largeRepeats : 1));
+}
+
+int main(int argc, char * argv[]) {
+    unsigned long rounds = 1 < argc ? strtoul(argv[1], NULL, 10) : 50;
+    if (!rounds) exit(1);
+    initOperands();
+    enum CpuLevel level = cpuLevel();
+    int failures = checkBuilders();
+    for (int l = level; CPU_SCALAR <= l; --l) {
+        bindGeometryKernels(l);
+        printf("kernels for %s\n", cpuLevelName(l));
+        failures += checkKernels();
+        for (unsigned long i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+            if ((int)level == l || benchmarks[i].kernel) runBenchmark(&benchmarks[i], rounds);
+        }
+    }
+    bindGeometryKernels(level);
+    struct Timing frame = measure(&frameCulling, FRAME_OBJECTS, 1, 1);
+    printf("cullSpheres frame of %d objects, %ld threads: %.3f +- %.3f ms, %s budget\n",
+        FRAME_OBJECTS, sysconf(_SC_NPROCESSORS_ONLN), frame.nanoseconds * FRAME_OBJECTS / 1e6,
+        frame.interval * FRAME_OBJECTS / 1e6, 
+        frame.nanoseconds * FRAME_OBJECTS <= FRAME_BUDGET ? "within" : "over");
+    if (failures) printf("%d results disagree with the scalar reference\n", failures);
+    return !!failures;
+}
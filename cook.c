@@ -0,0 +1,80 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include "mesh.h"
+#include "texture.h"
+#include "utils.h"
+
+/* cook [-j jobs] file...
+ *
+ * Builds the caches the demo loads OBJ meshes and textures from ahead of time, so at 
+ * runtime they only have to be mapped. Files whose content hash matches their cache 
+ * are skipped. Every file is cooked in a process of its own, at most jobs at a time, 
+ * since the OBJ parser keeps its state in globals. A .glb file needs no cache and is 
+ * only checked, so a broken one fails here rather than in the demo. */
+
+static int
+endsWith(const char * string, const char * suffix) {
+    size_t length = strlen(string), suffixLength = strlen(suffix);
+    return suffixLength <= length && !strcmp(string + length - suffixLength, suffix);
+}
+
+static int
+cookFile(char * filepath) {
+    int upToDate;
+    if (endsWith(filepath, ".obj")) {
+        upToDate = cookMesh(filepath);
+    } else if (endsWith(filepath, ".glb")) {
+        checkGlb(filepath);
+        printf("%s: checked\n", filepath);
+        return 0;
+    } else if (endsWith(filepath, ".png") || endsWith(filepath, ".tga") 
+            || endsWith(filepath, ".jpg") || endsWith(filepath, ".jpeg")) {
+        upToDate = cookTexture(filepath);
+    } else {
+        printf("%s: don't know how to cook\n", filepath);
+        return 1;
+    }
+    printf("%s: %s\n", filepath, upToDate ? "up to date" : "cooked");
+    return 0;
+}
+
+static int
+waitForJob(void) {
+    int status;
+    if (-1 == wait(&status)) exit(1);
+    return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char * argv[]) {
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+    if (3 <= argc && !strcmp(argv[1], "-j")) {
+        jobs = atol(argv[2]);
+        first = 3;
+    }
+    if (jobs < 1) jobs = 1;
+    long running = 0;
+    int failed = 0;
+    for (int i = first; i < argc; ++i) {
+        if (running == jobs) {
+            failed |= waitForJob();
+            --running;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (-1 == pid) exit(1);
+        if (!pid) exit(cookFile(argv[i]));
+        ++running;
+    }
+    for (; running; --running) failed |= waitForJob();
+    return failed;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+
+static const char * const levelNames[] = { "scalar", "sse", "avx2", "avx512" };
+
+static enum CpuLevel
+detectCpuLevel(void) {
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) return CPU_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return CPU_SSE;
+#endif
+    return CPU_SCALAR;
+}
+
+/* Runs from the constructors that bind the kernels, before main and any thread, so the
+ * cached level needs no lock. */
+extern enum CpuLevel
+cpuLevel(void) {
+    static int detected;
+    static enum CpuLevel level;
+    if (detected) return level;
+    level = detectCpuLevel();
+    const char * forced = getenv("CPU_LEVEL");
+    if (forced) {
+        int i = CPU_SCALAR;
+        while (i <= CPU_AVX512 && strcmp(forced, levelNames[i])) ++i;
+        if (CPU_AVX512 < i) {
+            fprintf(stderr, "CPU_LEVEL must be one of");
+            for (i = CPU_SCALAR; i <= CPU_AVX512; ++i) fprintf(stderr, " %s", levelNames[i]);
+            fprintf(stderr, ", not %s\n", forced);
+            exit(1);
+        }
+        if ((enum CpuLevel)i < level) level = i;
+    }
+    detected = 1;
+    return level;
+}
+
+extern const char *
+cpuLevelName(enum CpuLevel level) {
+    return levelNames[level];
+}
@@ -0,0 +1,21 @@
+/* Instruction set levels the hot kernels have variants for, each one implying the ones
+ * before it. Kernels are bound at startup to the variant of the highest level the CPU
+ * supports, or the one below it they have. */
+enum CpuLevel {
+    CPU_SCALAR,
+    CPU_SSE,     /* SSE4.2 */
+    CPU_AVX2,
+    CPU_AVX512,  /* AVX-512 F and BW */
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#define CPU_TARGET_SSE __attribute__((target("sse4.2")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+/* Detects the level once. CPU_LEVEL=scalar|sse|avx2|avx512 in the environment lowers
+ * it for testing, it never raises it above what the CPU supports. */
+extern enum CpuLevel cpuLevel(void);
+extern const char * cpuLevelName(enum CpuLevel level);
@@ -0,0 +1,381 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "fileio.h"
+#include "utils.h"
+#include "assetpack.h"
+
+/* readFiles reads a whole set of files at once, so that on volumes where every request
+ * has a long latency the files wait for their requests together instead of one after
+ * another. Opens and reads of all files are queued on an io_uring, and where there is
+ * no io_uring a pool of threads does blocking reads instead. Either way, done is called
+ * on the calling thread as soon as a file has been read, in the order reads finish. 
+ * Files in the asset pack need no reads and are done first. 
+ *
+ * The ring is only built against the io_uring header of Linux 5.6 or later, which 
+ * brought probing along with IORING_OP_READ. Anywhere else the pool is all there is. */
+
+#define MAX_RING_ENTRIES 64
+#define MAX_READ_THREADS 16
+#define MAX_READ_SIZE    (1 << 30)
+
+static int
+startRead(struct FileRead * read, int fd) {
+    struct stat status;
+    if (fstat(fd, &status)) return 1;
+    read->size = status.st_size;
+    read->content = emalloc(read->size + 1);
+    return 0;
+}
+
+static void
+finishRead(struct FileRead * read, int fd, int failed) {
+    if (0 <= fd) close(fd);
+    if (failed) {
+        free(read->content);
+        read->content = NULL;
+    } else {
+        read->content[read->size] = 0;
+    }
+}
+
+static void
+readFile(struct FileRead * read) {
+    int fd = open(read->filepath, O_RDONLY | O_CLOEXEC);
+    int failed = fd < 0 || startRead(read, fd);
+    for (size_t offset = 0; !failed && offset < read->size;) {
+        ssize_t size = pread(fd, read->content + offset, read->size - offset, offset);
+        if (size < 0 && EINTR == errno) continue;
+        if (size <= 0) failed = 1;
+        else offset += size;
+    }
+    finishRead(read, fd, failed);
+}
+
+#ifdef IO_URING_OP_SUPPORTED
+
+struct IoRing {
+    int fd;
+    unsigned * submissionTail;
+    unsigned * submissionMask;
+    unsigned * submissionArray;
+    struct io_uring_sqe * submissions;
+    unsigned * completionHead;
+    unsigned * completionTail;
+    unsigned * completionMask;
+    struct io_uring_cqe * completions;
+    void * submissionRing;
+    void * completionRing;
+    size_t submissionRingSize;
+    size_t completionRingSize;
+    size_t submissionsSize;
+    unsigned numberOfQueued;
+};
+
+/* Opens and reads arrived in the same kernel as probing, so a ring that cannot be 
+ * probed cannot do them either. */
+static int
+supportsRequests(int fd) {
+    unsigned numberOfOperations = IORING_OP_READ + 1;
+    size_t probeSize = sizeof(struct io_uring_probe) 
+        + numberOfOperations * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe * probe = emalloc(probeSize);
+    memset(probe, 0, probeSize);
+    int supported = 0 <= syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+            numberOfOperations)
+        && IORING_OP_OPENAT < probe->ops_len && IORING_OP_READ < probe->ops_len
+        && probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED
+        && probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED;
+    free(probe);
+    return supported;
+}
+
+/* Returns nonzero if the kernel has no io_uring for us. */
+static int
+setupRing(struct IoRing * ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return 1;
+    if (!supportsRequests(ring->fd)) {
+        close(ring->fd);
+        return 1;
+    }
+    ring->submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->completionRingSize = params.cq_off.cqes 
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->submissionsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->submissionRingSize < ring->completionRingSize) {
+            ring->submissionRingSize = ring->completionRingSize;
+        }
+        ring->completionRingSize = 0;
+    }
+    ring->submissionRing = mmap(NULL, ring->submissionRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->completionRing = ring->submissionRing;
+    if (MAP_FAILED != ring->submissionRing && ring->completionRingSize) {
+        ring->completionRing = mmap(NULL, ring->completionRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->submissions = mmap(NULL, ring->submissionsSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ring->submissionRing || MAP_FAILED == ring->completionRing
+            || MAP_FAILED == ring->submissions) exit(1);
+    char * submissionRing = ring->submissionRing;
+    char * completionRing = ring->completionRing;
+    ring->submissionTail  = (unsigned *)(submissionRing + params.sq_off.tail);
+    ring->submissionMask  = (unsigned *)(submissionRing + params.sq_off.ring_mask);
+    ring->submissionArray = (unsigned *)(submissionRing + params.sq_off.array);
+    ring->completionHead  = (unsigned *)(completionRing + params.cq_off.head);
+    ring->completionTail  = (unsigned *)(completionRing + params.cq_off.tail);
+    ring->completionMask  = (unsigned *)(completionRing + params.cq_off.ring_mask);
+    ring->completions     = (struct io_uring_cqe *)(completionRing + params.cq_off.cqes);
+    return 0;
+}
+
+static void
+closeRing(struct IoRing * ring) {
+    munmap(ring->submissions, ring->submissionsSize);
+    if (ring->completionRingSize) munmap(ring->completionRing, ring->completionRingSize);
+    munmap(ring->submissionRing, ring->submissionRingSize);
+    close(ring->fd);
+}
+
+/* The caller never has more requests in flight than the ring has entries, so there is
+ * always room for one more. */
+static struct io_uring_sqe *
+queueRequest(struct IoRing * ring, unsigned long index) {
+    unsigned tail = *ring->submissionTail + ring->numberOfQueued++;
+    unsigned slot = tail & *ring->submissionMask;
+    struct io_uring_sqe * request = &ring->submissions[slot];
+    memset(request, 0, sizeof(*request));
+    request->user_data = index;
+    ring->submissionArray[slot] = slot;
+    return request;
+}
+
+static void
+queueOpen(struct IoRing * ring, struct FileRead * read, unsigned long index) {
+    struct io_uring_sqe * request = queueRequest(ring, index);
+    request->opcode = IORING_OP_OPENAT;
+    request->fd = AT_FDCWD;
+    request->addr = (uintptr_t)read->filepath;
+    request->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+static void
+queueRead(struct IoRing * ring, struct FileRead * read, int fd, size_t offset,
+        unsigned long index) {
+    size_t size = read->size - offset;
+    struct io_uring_sqe * request = queueRequest(ring, index);
+    request->opcode = IORING_OP_READ;
+    request->fd = fd;
+    request->addr = (uintptr_t)(read->content + offset);
+    request->len = size < MAX_READ_SIZE ? size : MAX_READ_SIZE;
+    request->off = offset;
+}
+
+/* Submits what has been queued and waits for at least one completion. */
+static void
+submitRequests(struct IoRing * ring) {
+    __atomic_store_n(ring->submissionTail, *ring->submissionTail + ring->numberOfQueued,
+        __ATOMIC_RELEASE);
+    unsigned numberOfQueued = ring->numberOfQueued;
+    ring->numberOfQueued = 0;
+    while (0 > syscall(__NR_io_uring_enter, ring->fd, numberOfQueued, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0)) {
+        if (EINTR != errno) exit(1);
+        numberOfQueued = 0;
+    }
+}
+
+/* Every file has one request in flight at a time: its open, then its reads. Returns
+ * nonzero without reading anything if there is no io_uring that can do both. */
+static int
+readFilesWithRing(struct FileRead * reads, unsigned long count,
+        void (*done)(struct FileRead * read, unsigned long index, void * context), void * context) {
+    struct IoRing ring;
+    unsigned entries = count < MAX_RING_ENTRIES ? count : MAX_RING_ENTRIES;
+    if (setupRing(&ring, entries)) return 1;
+    int * fds = emalloc(count * sizeof(int));
+    size_t * offsets = emalloc(count * sizeof(size_t));
+    unsigned long numberOfStarted = 0, numberOfDone = 0;
+    for (; numberOfStarted < entries; ++numberOfStarted) {
+        fds[numberOfStarted] = -1;
+        queueOpen(&ring, &reads[numberOfStarted], numberOfStarted);
+    }
+    while (numberOfDone < count) {
+        submitRequests(&ring);
+        unsigned head = *ring.completionHead;
+        unsigned tail = __atomic_load_n(ring.completionTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            struct io_uring_cqe * completion = &ring.completions[head & *ring.completionMask];
+            unsigned long i = completion->user_data;
+            struct FileRead * read = &reads[i];
+            int result = completion->res;
+            int failed = 0, finished = 0;
+            if (fds[i] < 0) {
+                fds[i] = result;
+                offsets[i] = 0;
+                failed = result < 0 || startRead(read, fds[i]);
+            } else if (-EINTR != result && -EAGAIN != result) {
+                failed = result <= 0;
+                offsets[i] += 0 < result ? result : 0;
+            }
+            finished = failed || offsets[i] == read->size;
+            if (!finished) {
+                queueRead(&ring, read, fds[i], offsets[i], i);
+                continue;
+            }
+            finishRead(read, fds[i], failed);
+            ++numberOfDone;
+            if (numberOfStarted < count) {
+                fds[numberOfStarted] = -1;
+                queueOpen(&ring, &reads[numberOfStarted], numberOfStarted);
+                ++numberOfStarted;
+            }
+            done(read, i, context);
+        }
+        __atomic_store_n(ring.completionHead, head, __ATOMIC_RELEASE);
+    }
+    free(fds);
+    free(offsets);
+    closeRing(&ring);
+    return 0;
+}
+
+#else
+
+static int
+readFilesWithRing(struct FileRead * reads, unsigned long count,
+        void (*done)(struct FileRead * read, unsigned long index, void * context), void * context) {
+    (void)reads;
+    (void)count;
+    (void)done;
+    (void)context;
+    return 1;
+}
+
+#endif
+
+struct ReadPool {
+    struct FileRead * reads;
+    unsigned long count;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    unsigned long numberOfClaimed;
+    unsigned long numberOfFinished;
+    unsigned long * finishedReads; /* in the order they finished */
+};
+
+static void *
+runReadThread(void * argument) {
+    struct ReadPool * pool = argument;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->numberOfClaimed < pool->count) {
+        unsigned long i = pool->numberOfClaimed++;
+        pthread_mutex_unlock(&pool->lock);
+        readFile(&pool->reads[i]);
+        pthread_mutex_lock(&pool->lock);
+        pool->finishedReads[pool->numberOfFinished++] = i;
+        pthread_cond_signal(&pool->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void
+readFilesWithThreads(struct FileRead * reads, unsigned long count,
+        void (*done)(struct FileRead * read, unsigned long index, void * context), void * context) {
+    struct ReadPool pool = {
+        .reads = reads,
+        .count = count,
+        .finishedReads = emalloc(count * sizeof(unsigned long)),
+    };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+    unsigned long numberOfThreads = count < MAX_READ_THREADS ? count : MAX_READ_THREADS;
+    pthread_t threads[MAX_READ_THREADS];
+    for (unsigned long i = 0; i < numberOfThreads; ++i) {
+        if (pthread_create(&threads[i], NULL, runReadThread, &pool)) exit(1);
+    }
+    for (unsigned long numberOfDone = 0; numberOfDone < count; ++numberOfDone) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.numberOfFinished == numberOfDone) {
+            pthread_cond_wait(&pool.finished, &pool.lock);
+        }
+        unsigned long i = pool.finishedReads[numberOfDone];
+        pthread_mutex_unlock(&pool.lock);
+        done(&reads[i], i, context);
+    }
+    for (unsigned long i = 0; i < numberOfThreads; ++i) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.finished);
+    free(pool.finishedReads);
+}
+
+/* Files found in the asset pack are copied out of it right away, the others are read
+ * as loose files and handed back under their index in reads. */
+struct LooseReads {
+    struct FileRead * reads;
+    unsigned long * indices;
+    void (*done)(struct FileRead * read, unsigned long index, void * context);
+    void * context;
+};
+
+static void
+looseFileRead(struct FileRead * read, unsigned long index, void * context) {
+    struct LooseReads * loose = context;
+    unsigned long i = loose->indices[index];
+    loose->reads[i] = *read;
+    loose->done(&loose->reads[i], i, loose->context);
+}
+
+extern void
+readFiles(struct FileRead * reads, unsigned long count,
+        void (*done)(struct FileRead * read, unsigned long index, void * context), void * context) {
+    struct LooseReads loose = { reads, emalloc(count * sizeof(unsigned long)), done, context };
+    struct FileRead * looseReads = emalloc(count * sizeof(struct FileRead));
+    unsigned long numberOfLooseReads = 0;
+    for (unsigned long i = 0; i < count; ++i) {
+        struct FileStamp stamp;
+        size_t mappingSize;
+        reads[i].content = NULL;
+        reads[i].size = 0;
+        if (stampPackedFile(reads[i].filepath, &stamp)) {
+            loose.indices[numberOfLooseReads] = i;
+            looseReads[numberOfLooseReads++] = reads[i];
+            continue;
+        }
+        char * mapping = mapPackedFile(reads[i].filepath, &mappingSize);
+        reads[i].size = stamp.size;
+        reads[i].content = emalloc(stamp.size + 1);
+        memcpy(reads[i].content, mapping, stamp.size);
+        reads[i].content[stamp.size] = 0;
+        unmapFile(mapping, mappingSize);
+        done(&reads[i], i, context);
+    }
+    if (numberOfLooseReads && readFilesWithRing(looseReads, numberOfLooseReads, 
+            looseFileRead, &loose)) {
+        readFilesWithThreads(looseReads, numberOfLooseReads, looseFileRead, &loose);
+    }
+    free(loose.indices);
+    free(looseReads);
+}
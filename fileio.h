@@ -0,0 +1,8 @@
+struct FileRead {
+    const char * filepath;
+    char * content; /* NULL if the read failed, else zero terminated and freed by the caller */
+    size_t size;
+};
+
+extern void readFiles(struct FileRead * reads, unsigned long count,
+    void (*done)(struct FileRead * read, unsigned long index, void * context), void * context);
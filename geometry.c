@@ -1,10 +1,17 @@
+#define _GNU_SOURCE
+
 #include <math.h>
 #include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
+#include "cpu.h"
 #include "geometry.h"
+#include "utils.h"
 
 extern void
 matrixOfPerspective(GLfloat * matrix, 
@@ -160,3 +167,784 @@ matrixInverse(GLfloat * out, GLfloat * in) {
     matrixMultiplymd(out, inv, 1 / d);
     return 0;
 }
+
+static enum TransformKind
+kindOfScale(const GLfloat * scale) {
+    if (scale[0] != scale[1] || scale[1] != scale[2]) return TRANSFORM_AFFINE;
+    return 1 == scale[0] ? TRANSFORM_RIGID : TRANSFORM_UNIFORM_SCALE;
+}
+
+static enum TransformKind
+storeTrs(Mat4 * matrix, const GLfloat * translation, GLfloat (*r)[3], const GLfloat * scale) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) MAT4_AT(matrix, i, j) = r[i][j] * scale[j];
+        MAT4_AT(matrix, i, 3) = translation[i];
+        MAT4_AT(matrix, 3, i) = 0;
+    }
+    MAT4_AT(matrix, 3, 3) = 1;
+    return kindOfScale(scale);
+}
+
+/* R is Rz Ry Rx multiplied out. */
+extern enum TransformKind
+mat4OfTrs(Mat4 * matrix, const GLfloat * translation, const GLfloat * angles, 
+        const GLfloat * scale) {
+    GLfloat sx, cx, sy, cy, sz, cz;
+    sincosf(angles[0], &sx, &cx);
+    sincosf(angles[1], &sy, &cy);
+    sincosf(angles[2], &sz, &cz);
+    GLfloat r[3][3] = {
+        { cy * cz, sx * sy * cz - cx * sz, cx * sy * cz + sx * sz },
+        { cy * sz, sx * sy * sz + cx * cz, cx * sy * sz - sx * cz },
+        { -sy, sx * cy, cx * cy },
+    };
+    return storeTrs(matrix, translation, r, scale);
+}
+
+extern enum TransformKind
+mat4OfTrsQuaternion(Mat4 * matrix, const GLfloat * translation, const GLfloat * rotation, 
+        const GLfloat * scale) {
+    GLfloat x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+    GLfloat r[3][3] = {
+        { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y) },
+        { 2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+        { 2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) },
+    };
+    return storeTrs(matrix, translation, r, scale);
+}
+
+/* The Mat4 builders write rows like the builders above, then reorder them if storage is 
+ * column major. */
+static void
+rowsToStorage(Mat4 * matrix) {
+#ifdef MATRIX_COLUMN_MAJOR
+    matrixTranspose(matrix->m, matrix->m);
+#else
+    (void)matrix;
+#endif
+}
+
+extern void
+mat4OfPerspective(Mat4 * matrix, 
+        GLfloat l, GLfloat r, GLfloat b, GLfloat t, GLfloat n, GLfloat f) {
+    matrixOfPerspective(matrix->m, l, r, b, t, n, f);
+    rowsToStorage(matrix);
+}
+
+extern void
+mat4OfIdentity(Mat4 * matrix) {
+    matrixOfIdentity(matrix->m);
+}
+
+extern void
+mat4OfScale(Mat4 * matrix, GLfloat sx, GLfloat sy, GLfloat sz) {
+    matrixOfScale(matrix->m, sx, sy, sz);
+}
+
+extern void
+mat4OfTranslation(Mat4 * matrix, GLfloat dx, GLfloat dy, GLfloat dz) {
+    matrixOfTranslation(matrix->m, dx, dy, dz);
+    rowsToStorage(matrix);
+}
+
+extern void
+mat4OfRotationX(Mat4 * matrix, GLfloat angle) {
+    matrixOfRotationX(matrix->m, angle);
+    rowsToStorage(matrix);
+}
+
+extern void
+mat4OfRotationY(Mat4 * matrix, GLfloat angle) {
+    matrixOfRotationY(matrix->m, angle);
+    rowsToStorage(matrix);
+}
+
+extern void
+mat4OfRotationZ(Mat4 * matrix, GLfloat angle) {
+    matrixOfRotationZ(matrix->m, angle);
+    rowsToStorage(matrix);
+}
+
+/* Multiplies as if storage were row major. The transpose of a product is the product of 
+ * the transposes in reverse order, so column major storage swaps the operands. The sums 
+ * of every variant run in the order of matrixMultiplymm to get the same roundings. */
+static void
+multiplyRowsScalar(GLfloat * out, const GLfloat * a, const GLfloat * b) {
+    matrixMultiplymm(out, (GLfloat *)a, (GLfloat *)b);
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE void
+multiplyRowsSse(GLfloat * out, const GLfloat * a, const GLfloat * b) {
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_loadu_ps(b + 12);
+    __m128 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a[i * 4]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 2]), b2));
+        rows[i] = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 3]), b3));
+    }
+    for (int i = 0; i < 4; ++i) _mm_storeu_ps(out + i * 4, rows[i]);
+}
+
+/* Two rows at a time */
+static CPU_TARGET_AVX2 void
+multiplyRowsAvx2(GLfloat * out, const GLfloat * a, const GLfloat * b) {
+    __m256 b0 = _mm256_broadcast_ps((const __m128 *)b);
+    __m256 b1 = _mm256_broadcast_ps((const __m128 *)(b + 4));
+    __m256 b2 = _mm256_broadcast_ps((const __m128 *)(b + 8));
+    __m256 b3 = _mm256_broadcast_ps((const __m128 *)(b + 12));
+    __m256 rows[2];
+    for (int i = 0; i < 2; ++i) {
+        __m256 a01 = _mm256_loadu_ps(a + i * 8);
+        __m256 sum = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2));
+        rows[i] = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xff), b3));
+    }
+    _mm256_storeu_ps(out, rows[0]);
+    _mm256_storeu_ps(out + 8, rows[1]);
+}
+
+/* All four rows in one register, the shuffles work within each row. */
+static CPU_TARGET_AVX512 void
+multiplyRowsAvx512(GLfloat * out, const GLfloat * a, const GLfloat * b) {
+    __m512 rows = _mm512_loadu_ps(a);
+    __m512 sum = _mm512_mul_ps(_mm512_shuffle_ps(rows, rows, 0x00), 
+        _mm512_broadcast_f32x4(_mm_loadu_ps(b)));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_shuffle_ps(rows, rows, 0x55), 
+        _mm512_broadcast_f32x4(_mm_loadu_ps(b + 4))));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_shuffle_ps(rows, rows, 0xaa), 
+        _mm512_broadcast_f32x4(_mm_loadu_ps(b + 8))));
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_shuffle_ps(rows, rows, 0xff), 
+        _mm512_broadcast_f32x4(_mm_loadu_ps(b + 12))));
+    _mm512_storeu_ps(out, sum);
+}
+
+#endif
+
+/* The kernels in use are bound by bindGeometryKernels, at startup. */
+static void (*multiplyRows)(GLfloat * out, const GLfloat * a, const GLfloat * b) 
+    = multiplyRowsScalar;
+
+extern void
+mat4Multiply(Mat4 * out, const Mat4 * a, const Mat4 * b) {
+#ifdef MATRIX_COLUMN_MAJOR
+    multiplyRows(out->m, b->m, a->m);
+#else
+    multiplyRows(out->m, a->m, b->m);
+#endif
+}
+
+/* Column j of a product is the first matrix times column j of the second. A translation
+ * only has a column 3 of its own, a scale scales columns, and a rotation about X mixes
+ * columns 1 and 2. */
+extern void
+mat4Translate(Mat4 * matrix, GLfloat dx, GLfloat dy, GLfloat dz) {
+    for (int i = 0; i < 4; ++i) {
+        MAT4_AT(matrix, i, 3) = MAT4_AT(matrix, i, 0) * dx + MAT4_AT(matrix, i, 1) * dy 
+            + MAT4_AT(matrix, i, 2) * dz + MAT4_AT(matrix, i, 3);
+    }
+}
+
+extern void
+mat4Scale(Mat4 * matrix, GLfloat sx, GLfloat sy, GLfloat sz) {
+    for (int i = 0; i < 4; ++i) {
+        MAT4_AT(matrix, i, 0) *= sx;
+        MAT4_AT(matrix, i, 1) *= sy;
+        MAT4_AT(matrix, i, 2) *= sz;
+    }
+}
+
+/* Mixes columns j and k by the sine and cosine the rotation builders store. */
+static void
+rotateColumns(Mat4 * matrix, int j, int k, GLfloat c, GLfloat s) {
+    for (int i = 0; i < 4; ++i) {
+        GLfloat a = MAT4_AT(matrix, i, j), b = MAT4_AT(matrix, i, k);
+        MAT4_AT(matrix, i, j) = a * c + b * s;
+        MAT4_AT(matrix, i, k) = a * -s + b * c;
+    }
+}
+
+extern void
+mat4RotateX(Mat4 * matrix, GLfloat angle) {
+    rotateColumns(matrix, 1, 2, cos(angle), sin(angle));
+}
+
+extern void
+mat4RotateY(Mat4 * matrix, GLfloat angle) {
+    rotateColumns(matrix, 2, 0, cos(angle), sin(angle));
+}
+
+extern void
+mat4RotateZ(Mat4 * matrix, GLfloat angle) {
+    rotateColumns(matrix, 0, 1, cos(angle), sin(angle));
+}
+
+/* Both bottom rows are 0 0 0 1, so is that of the product, and its other rows skip the
+ * products with the zeros of the bottom row of b. With column major storage, column j of
+ * the product is a sum of the first three columns of a, plus the last one for j = 3. 
+ * With row major storage, row 3 of b only adds a[i][3] to row i at column 3. From AVX2
+ * on, the full product of two rows at a time beats skipping a quarter of the SSE one. */
+static void
+multiplyAffineScalar(Mat4 * out, const Mat4 * a, const Mat4 * b) {
+    Mat4 product;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            MAT4_AT(&product, i, j) = MAT4_AT(a, i, 0) * MAT4_AT(b, 0, j) 
+                + MAT4_AT(a, i, 1) * MAT4_AT(b, 1, j) + MAT4_AT(a, i, 2) * MAT4_AT(b, 2, j);
+        }
+        MAT4_AT(&product, i, 3) = MAT4_AT(a, i, 0) * MAT4_AT(b, 0, 3) 
+            + MAT4_AT(a, i, 1) * MAT4_AT(b, 1, 3) + MAT4_AT(a, i, 2) * MAT4_AT(b, 2, 3)
+            + MAT4_AT(a, i, 3);
+        MAT4_AT(&product, 3, i) = 0;
+    }
+    MAT4_AT(&product, 3, 3) = 1;
+    *out = product;
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE void
+multiplyAffineSse(Mat4 * out, const Mat4 * a, const Mat4 * b) {
+#ifdef MATRIX_COLUMN_MAJOR
+    __m128 a0 = _mm_load_ps(a->m);
+    __m128 a1 = _mm_load_ps(a->m + 4);
+    __m128 a2 = _mm_load_ps(a->m + 8);
+    __m128 a3 = _mm_load_ps(a->m + 12);
+    __m128 columns[4];
+    for (int j = 0; j < 4; ++j) {
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(b->m[j * 4]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(b->m[j * 4 + 1])));
+        columns[j] = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(b->m[j * 4 + 2])));
+    }
+    /* Adding 0 makes a -0 at the bottom +0, as the 0 * a3 term of the full product does */
+    for (int j = 0; j < 3; ++j) columns[j] = _mm_add_ps(columns[j], _mm_setzero_ps());
+    columns[3] = _mm_add_ps(columns[3], a3);
+    for (int j = 0; j < 4; ++j) _mm_store_ps(out->m + j * 4, columns[j]);
+#else
+    __m128 b0 = _mm_load_ps(b->m);
+    __m128 b1 = _mm_load_ps(b->m + 4);
+    __m128 b2 = _mm_load_ps(b->m + 8);
+    __m128 rows[3];
+    for (int i = 0; i < 3; ++i) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a->m[i * 4]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a->m[i * 4 + 1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a->m[i * 4 + 2]), b2));
+        rows[i] = _mm_add_ps(sum, _mm_setr_ps(0, 0, 0, a->m[i * 4 + 3]));
+    }
+    for (int i = 0; i < 3; ++i) _mm_store_ps(out->m + i * 4, rows[i]);
+    _mm_store_ps(out->m + 12, _mm_setr_ps(0, 0, 0, 1));
+#endif
+}
+
+#endif
+
+static void (*multiplyAffine)(Mat4 * out, const Mat4 * a, const Mat4 * b) 
+    = multiplyAffineScalar;
+
+extern void
+mat4MultiplyAffine(Mat4 * out, const Mat4 * a, const Mat4 * b) {
+    multiplyAffine(out, a, b);
+}
+
+/* The rows of a perspective are x = (a 0 b 0), y = (0 c d 0), z = (0 0 e f) and 
+ * w = (0 0 -1 0), so each row of the product mixes at most two rows of b. */
+extern void
+mat4MultiplyPerspective(Mat4 * out, const Mat4 * perspective, const Mat4 * b) {
+    GLfloat p00 = MAT4_AT(perspective, 0, 0), p02 = MAT4_AT(perspective, 0, 2);
+    GLfloat p11 = MAT4_AT(perspective, 1, 1), p12 = MAT4_AT(perspective, 1, 2);
+    GLfloat p22 = MAT4_AT(perspective, 2, 2), p23 = MAT4_AT(perspective, 2, 3);
+    GLfloat p32 = MAT4_AT(perspective, 3, 2);
+    for (int j = 0; j < 4; ++j) {
+        GLfloat b0 = MAT4_AT(b, 0, j), b1 = MAT4_AT(b, 1, j);
+        GLfloat b2 = MAT4_AT(b, 2, j), b3 = MAT4_AT(b, 3, j);
+        MAT4_AT(out, 0, j) = p00 * b0 + p02 * b2;
+        MAT4_AT(out, 1, j) = p11 * b1 + p12 * b2;
+        MAT4_AT(out, 2, j) = p22 * b2 + p23 * b3;
+        MAT4_AT(out, 3, j) = p32 * b2;
+    }
+}
+
+static void
+transposeScalar(Mat4 * out, const Mat4 * in) {
+    matrixTranspose(out->m, (GLfloat *)in->m);
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE void
+transposeSse(Mat4 * out, const Mat4 * in) {
+    __m128 r0 = _mm_load_ps(in->m);
+    __m128 r1 = _mm_load_ps(in->m + 4);
+    __m128 r2 = _mm_load_ps(in->m + 8);
+    __m128 r3 = _mm_load_ps(in->m + 12);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_store_ps(out->m, r0);
+    _mm_store_ps(out->m + 4, r1);
+    _mm_store_ps(out->m + 8, r2);
+    _mm_store_ps(out->m + 12, r3);
+}
+
+#define SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+
+/* Products of 2x2 row major matrices packed in one vector, with # for the adjugate. */
+static CPU_TARGET_SSE __m128
+multiply2x2(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)),
+        _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* a# b */
+static CPU_TARGET_SSE __m128
+adjugateMultiply2x2(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b),
+        _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+/* a b# */
+static CPU_TARGET_SSE __m128
+multiplyAdjugate2x2(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)),
+        _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* Inverts by 2x2 blocks [A B; C D]. The inverse of a transpose is the transpose of the 
+ * inverse, so it works on either storage order. */
+static CPU_TARGET_SSE int
+inverseSse(Mat4 * out, const Mat4 * in) {
+    __m128 r0 = _mm_load_ps(in->m);
+    __m128 r1 = _mm_load_ps(in->m + 4);
+    __m128 r2 = _mm_load_ps(in->m + 8);
+    __m128 r3 = _mm_load_ps(in->m + 12);
+    __m128 a = _mm_movelh_ps(r0, r1);
+    __m128 b = _mm_movehl_ps(r1, r0);
+    __m128 c = _mm_movelh_ps(r2, r3);
+    __m128 d = _mm_movehl_ps(r3, r2);
+    /* |A| |B| |C| |D| */
+    __m128 determinants = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), 
+            _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), 
+            _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 determinantA = SWIZZLE(determinants, 0, 0, 0, 0);
+    __m128 determinantB = SWIZZLE(determinants, 1, 1, 1, 1);
+    __m128 determinantC = SWIZZLE(determinants, 2, 2, 2, 2);
+    __m128 determinantD = SWIZZLE(determinants, 3, 3, 3, 3);
+    __m128 dc = adjugateMultiply2x2(d, c);
+    __m128 ab = adjugateMultiply2x2(a, b);
+    /* Adjugates of the blocks of the inverse times |M| */
+    __m128 x = _mm_sub_ps(_mm_mul_ps(determinantD, a), multiply2x2(b, dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(determinantA, d), multiply2x2(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(determinantB, c), multiplyAdjugate2x2(d, ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(determinantC, b), multiplyAdjugate2x2(a, dc));
+    /* |M| = |A| |D| + |B| |C| - tr(A# B D# C) */
+    __m128 trace = _mm_mul_ps(ab, SWIZZLE(dc, 0, 2, 1, 3));
+    trace = _mm_add_ps(trace, SWIZZLE(trace, 2, 3, 0, 1));
+    trace = _mm_add_ps(trace, SWIZZLE(trace, 1, 0, 3, 2));
+    __m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(determinantA, determinantD), 
+        _mm_mul_ps(determinantB, determinantC)), trace);
+    if (!_mm_cvtss_f32(determinant)) return 1;
+    __m128 scale = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), determinant);
+    x = _mm_mul_ps(x, scale);
+    y = _mm_mul_ps(y, scale);
+    z = _mm_mul_ps(z, scale);
+    w = _mm_mul_ps(w, scale);
+    _mm_store_ps(out->m, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(out->m + 4, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_store_ps(out->m + 8, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(out->m + 12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return 0;
+}
+
+#endif
+
+static int
+inverseScalar(Mat4 * out, const Mat4 * in) {
+    return matrixInverse(out->m, (GLfloat *)in->m);
+}
+
+static void (*transpose)(Mat4 * out, const Mat4 * in) = transposeScalar;
+static int (*inverse)(Mat4 * out, const Mat4 * in) = inverseScalar;
+
+extern void
+mat4Transpose(Mat4 * out, const Mat4 * in) {
+    transpose(out, in);
+}
+
+extern int
+mat4Inverse(Mat4 * out, const Mat4 * in) {
+    return inverse(out, in);
+}
+
+/* Cofactors of the upper 3x3 of in, returns its determinant. */
+static GLfloat
+cofactors3x3(GLfloat (*cofactors)[3], const Mat4 * in) {
+    GLfloat m[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) m[i][j] = MAT4_AT(in, i, j);
+    }
+    cofactors[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    cofactors[0][1] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    cofactors[0][2] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    cofactors[1][0] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+    cofactors[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+    cofactors[1][2] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+    cofactors[2][0] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+    cofactors[2][1] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+    cofactors[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    return m[0][0] * cofactors[0][0] + m[0][1] * cofactors[0][1] 
+        + m[0][2] * cofactors[0][2];
+}
+
+/* For a rotation scaled by s, returns 1 / s^2, the length of a column squared. */
+static GLfloat
+inverseSquaredScale(const Mat4 * in, enum TransformKind kind) {
+    if (TRANSFORM_RIGID == kind) return 1;
+    GLfloat s = MAT4_AT(in, 0, 0) * MAT4_AT(in, 0, 0) + MAT4_AT(in, 1, 0) * MAT4_AT(in, 1, 0)
+        + MAT4_AT(in, 2, 0) * MAT4_AT(in, 2, 0);
+    return s ? 1 / s : 0;
+}
+
+/* The inverse of [L t; 0 1] is [L' -L't; 0 1] with L' the inverse of L, which is the 
+ * transpose of L over s^2 if L is a rotation scaled by s. */
+extern int
+mat4InverseOfKind(Mat4 * out, const Mat4 * in, enum TransformKind kind) {
+    if (TRANSFORM_GENERAL == kind) return mat4Inverse(out, in);
+    GLfloat linear[3][3];
+    if (TRANSFORM_AFFINE == kind) {
+        GLfloat cofactors[3][3];
+        GLfloat d = cofactors3x3(cofactors, in);
+        if (!d) return 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) linear[i][j] = cofactors[j][i] / d;
+        }
+    } else {
+        GLfloat r = inverseSquaredScale(in, kind);
+        if (!r) return 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) linear[i][j] = MAT4_AT(in, j, i) * r;
+        }
+    }
+    GLfloat t[3] = { MAT4_AT(in, 0, 3), MAT4_AT(in, 1, 3), MAT4_AT(in, 2, 3) };
+    Mat4 inverse;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) MAT4_AT(&inverse, i, j) = linear[i][j];
+        MAT4_AT(&inverse, i, 3) = -(linear[i][0] * t[0] + linear[i][1] * t[1] 
+            + linear[i][2] * t[2]);
+        MAT4_AT(&inverse, 3, i) = 0;
+    }
+    MAT4_AT(&inverse, 3, 3) = 1;
+    *out = inverse;
+    return 0;
+}
+
+/* The inverse transpose of a rotation scaled by s is the matrix over s^2, and that of 
+ * any other 3x3 its cofactors over its determinant. */
+static int
+normalMatrixOfKind(Mat3 * out, const Mat4 * in, enum TransformKind kind) {
+    if (TRANSFORM_GENERAL == kind) {
+        Mat4 inverse;
+        if (mat4Inverse(&inverse, in)) return 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) MAT3_AT(out, i, j) = MAT4_AT(&inverse, j, i);
+        }
+    } else if (TRANSFORM_AFFINE == kind) {
+        GLfloat cofactors[3][3];
+        GLfloat d = cofactors3x3(cofactors, in);
+        if (!d) return 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) MAT3_AT(out, i, j) = cofactors[i][j] / d;
+        }
+    } else {
+        GLfloat r = inverseSquaredScale(in, kind);
+        if (!r) return 1;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) MAT3_AT(out, i, j) = MAT4_AT(in, i, j) * r;
+        }
+    }
+    return 0;
+}
+
+extern int
+mat4NormalMatrix(Mat3 * out, const Mat4 * in, enum TransformKind kind) {
+    if (!normalMatrixOfKind(out, in, kind)) return 0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) MAT3_AT(out, i, j) = i == j;
+    }
+    return 1;
+}
+
+static void
+transformVectorsScalar(GLfloat * out, const Mat4 * matrix, const GLfloat * vectors,
+        unsigned long count) {
+    for (unsigned long i = 0; i < count; ++i) {
+        GLfloat temp[4];
+        for (int j = 0; j < 4; ++j) {
+            temp[j] = 0;
+            for (int k = 0; k < 4; ++k) {
+                temp[j] += MAT4_AT(matrix, j, k) * vectors[i * 4 + k];
+            }
+        }
+        memcpy(out + i * 4, temp, sizeof(temp));
+    }
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE void
+transformVectorsSse(GLfloat * out, const Mat4 * matrix, const GLfloat * vectors,
+        unsigned long count) {
+    __m128 c0 = _mm_load_ps(matrix->m);
+    __m128 c1 = _mm_load_ps(matrix->m + 4);
+    __m128 c2 = _mm_load_ps(matrix->m + 8);
+    __m128 c3 = _mm_load_ps(matrix->m + 12);
+#ifndef MATRIX_COLUMN_MAJOR
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+#endif
+    for (unsigned long i = 0; i < count; ++i) {
+        const GLfloat * v = vectors + i * 4;
+        __m128 sum = _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+        _mm_storeu_ps(out + i * 4, _mm_add_ps(sum, _mm_mul_ps(c3, _mm_set1_ps(v[3]))));
+    }
+}
+
+#endif
+
+static void (*transformVectors)(GLfloat * out, const Mat4 * matrix, const GLfloat * vectors,
+    unsigned long count) = transformVectorsScalar;
+
+extern void
+mat4TransformVectors(GLfloat * out, const Mat4 * matrix, const GLfloat * vectors,
+        unsigned long count) {
+    transformVectors(out, matrix, vectors, count);
+}
+
+/* Objects per task of composeTransforms and cullSpheres, a multiple of every LANES. */
+#define OBJECTS_PER_TASK 8192
+
+struct Composition {
+    Mat4 * modelViews;
+    Mat3 * normalMatrices;
+    const GLfloat * components[10]; /* translation, rotation, scale */
+    int euler;                      /* the rotation is 3 angles, components[6] is NULL */
+    unsigned long count;
+    GLfloat view[4][4];
+    GLfloat viewNormal[3][3];
+};
+
+struct Culling {
+    GLfloat planes[6][4];
+    const struct BoundingSpheres * spheres;
+    GLuint * visible;
+    unsigned long * counts; /* of visible spheres per task */
+};
+
+/* The sphere test of the kernels, in their order of operations */
+static int
+sphereReaches(const struct Culling * culling, unsigned long i) {
+    const GLfloat (*planes)[4] = culling->planes;
+    const struct BoundingSpheres * spheres = culling->spheres;
+    for (int p = 0; p < 6; ++p) {
+        GLfloat distance = planes[p][0] * spheres->center[0][i] 
+            + planes[p][1] * spheres->center[1][i] + planes[p][2] * spheres->center[2][i];
+        if (distance + planes[p][3] + spheres->radius[i] < 0) return 0;
+    }
+    return 1;
+}
+
+#define LANES_PASTE(name, suffix) name##suffix
+#define LANES_SUFFIX(name, suffix) LANES_PASTE(name, suffix)
+
+#define LANES 1
+#define LANES_NAME(name) LANES_SUFFIX(name, Scalar)
+#define Lanes GLfloat
+#define lanesLoad(p) (*(p))
+#define lanesStore(p, v) (*(p) = (v))
+#define lanesSet(x) ((GLfloat)(x))
+#define lanesAdd(a, b) ((a) + (b))
+#define lanesSub(a, b) ((a) - (b))
+#define lanesMul(a, b) ((a) * (b))
+#define lanesDiv(a, b) ((a) / (b))
+#define lanesMin(a, b) ((a) < (b) ? (a) : (b))
+#define lanesNonNegative(x) (0 <= (x))
+#include "geometrylanes.h"
+
+#ifdef CPU_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#define LANES 4
+#define LANES_NAME(name) LANES_SUFFIX(name, Sse)
+#define Lanes __m128
+#define lanesLoad _mm_loadu_ps
+#define lanesStore _mm_storeu_ps
+#define lanesSet _mm_set1_ps
+#define lanesAdd _mm_add_ps
+#define lanesSub _mm_sub_ps
+#define lanesMul _mm_mul_ps
+#define lanesDiv _mm_div_ps
+#define lanesMin _mm_min_ps
+#define lanesNonNegative(x) _mm_movemask_ps(_mm_cmpge_ps(x, _mm_setzero_ps()))
+#include "geometrylanes.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define LANES 8
+#define LANES_NAME(name) LANES_SUFFIX(name, Avx2)
+#define Lanes __m256
+#define lanesLoad _mm256_loadu_ps
+#define lanesStore _mm256_storeu_ps
+#define lanesSet _mm256_set1_ps
+#define lanesAdd _mm256_add_ps
+#define lanesSub _mm256_sub_ps
+#define lanesMul _mm256_mul_ps
+#define lanesDiv _mm256_div_ps
+#define lanesMin _mm256_min_ps
+#define lanesNonNegative(x) \
+    _mm256_movemask_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GE_OQ))
+#include "geometrylanes.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#define LANES 16
+#define LANES_NAME(name) LANES_SUFFIX(name, Avx512)
+#define Lanes __m512
+#define lanesLoad _mm512_loadu_ps
+#define lanesStore _mm512_storeu_ps
+#define lanesSet _mm512_set1_ps
+#define lanesAdd _mm512_add_ps
+#define lanesSub _mm512_sub_ps
+#define lanesMul _mm512_mul_ps
+#define lanesDiv _mm512_div_ps
+#define lanesMin _mm512_min_ps
+#define lanesNonNegative(x) _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GE_OQ)
+#include "geometrylanes.h"
+#pragma GCC pop_options
+
+#endif
+
+static void (*composeObjects)(void * context, unsigned long begin, unsigned long end) 
+    = composeObjectsScalar;
+static void (*cullObjects)(void * context, unsigned long begin, unsigned long end) 
+    = cullObjectsScalar;
+
+extern void
+composeTransforms(Mat4 * modelViews, Mat3 * normalMatrices, const Mat4 * view,
+        const struct TransformArrays * objects) {
+    struct Composition composition = {
+        .modelViews = modelViews,
+        .normalMatrices = normalMatrices,
+        .count = objects->count,
+    };
+    for (int i = 0; i < 3; ++i) {
+        composition.components[i] = objects->translation[i];
+        composition.components[7 + i] = objects->scale[i];
+    }
+    composition.euler = !objects->rotation[0];
+    for (int i = 0; i < 4; ++i) {
+        composition.components[3 + i] = composition.euler ? 
+            (i < 3 ? objects->angles[i] : NULL) : objects->rotation[i];
+    }
+    /* A singular view has no normal matrix, normals then skip the view */
+    Mat3 viewNormal;
+    mat4NormalMatrix(&viewNormal, view, TRANSFORM_AFFINE);
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) composition.view[i][j] = MAT4_AT(view, i, j);
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) composition.viewNormal[i][j] = MAT3_AT(&viewNormal, i, j);
+    }
+    parallelFor((objects->count + OBJECTS_PER_TASK - 1) / OBJECTS_PER_TASK, composeObjects,
+        &composition);
+}
+
+/* Row 3 of the matrix plus or minus row i bounds clip coordinate i, since a point is in
+ * the clip volume when -w <= x, y, z <= w. */
+extern void
+frustumOfMatrix(struct Frustum * frustum, const Mat4 * matrix) {
+    for (int p = 0; p < 6; ++p) {
+        GLfloat sign = p % 2 ? -1 : 1;
+        for (int j = 0; j < 4; ++j) {
+            frustum->planes[p][j] = MAT4_AT(matrix, 3, j) + sign * MAT4_AT(matrix, p / 2, j);
+        }
+        GLfloat * plane = frustum->planes[p];
+        GLfloat length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] 
+            + plane[2] * plane[2]);
+        for (int j = 0; j < 4; ++j) plane[j] /= length;
+    }
+}
+
+/* Each task writes its visible spheres from its own first index on, then they move down
+ * in order. */
+extern unsigned long
+cullSpheres(GLuint * visible, const struct Frustum * frustum, 
+        const struct BoundingSpheres * spheres) {
+    unsigned long numberOfTasks = (spheres->count + OBJECTS_PER_TASK - 1) / OBJECTS_PER_TASK;
+    if (!numberOfTasks) return 0;
+    struct Culling culling = {
+        .spheres = spheres,
+        .visible = visible,
+        .counts = emalloc(numberOfTasks * sizeof(unsigned long)),
+    };
+    memcpy(culling.planes, frustum->planes, sizeof(culling.planes));
+    /* A frame of a few objects skips the threads */
+    if (1 == numberOfTasks) cullObjects(&culling, 0, 1);
+    else parallelFor(numberOfTasks, cullObjects, &culling);
+    unsigned long numberOfVisible = culling.counts[0];
+    for (unsigned long i = 1; i < numberOfTasks; ++i) {
+        memmove(visible + numberOfVisible, visible + i * OBJECTS_PER_TASK, 
+            culling.counts[i] * sizeof(GLuint));
+        numberOfVisible += culling.counts[i];
+    }
+    free(culling.counts);
+    return numberOfVisible;
+}
+
+extern void
+bindGeometryKernels(enum CpuLevel level) {
+    multiplyRows = multiplyRowsScalar;
+    multiplyAffine = multiplyAffineScalar;
+    transpose = transposeScalar;
+    inverse = inverseScalar;
+    transformVectors = transformVectorsScalar;
+    composeObjects = composeObjectsScalar;
+    cullObjects = cullObjectsScalar;
+#ifdef CPU_X86
+    if (CPU_SSE <= level) {
+        multiplyRows = multiplyRowsSse;
+        multiplyAffine = multiplyAffineSse;
+        transpose = transposeSse;
+        inverse = inverseSse;
+        transformVectors = transformVectorsSse;
+        composeObjects = composeObjectsSse;
+        cullObjects = cullObjectsSse;
+    }
+    if (CPU_AVX2 <= level) {
+        multiplyRows = multiplyRowsAvx2;
+        multiplyAffine = mat4Multiply;
+        composeObjects = composeObjectsAvx2;
+        cullObjects = cullObjectsAvx2;
+    }
+    if (CPU_AVX512 <= level) {
+        multiplyRows = multiplyRowsAvx512;
+        composeObjects = composeObjectsAvx512;
+        cullObjects = cullObjectsAvx512;
+    }
+#else
+    (void)level;
+#endif
+}
+
+static void __attribute__((constructor))
+bindGeometryKernelsAtStartup(void) {
+    bindGeometryKernels(cpuLevel());
+}
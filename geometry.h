@@ -17,3 +17,128 @@ extern void matrixMultiplymm(GLfloat * out, GLfloat * a, GLfloat * b);
 
 extern void matrixTranspose(GLfloat * out, GLfloat * in);
 extern int matrixInverse(GLfloat * out, GLfloat * in);
+
+/* A 4x4 matrix aligned for the SIMD paths. Storage is row major unless built with
+ * MATRIX_COLUMN_MAJOR, which is the order GL takes, so uploads need no transpose. 
+ * Pass MATRIX_TRANSPOSE to glUniformMatrix4fv either way. */
+typedef struct {
+    GLfloat m[16];
+} __attribute__((aligned(16))) Mat4;
+
+/* A 3x3 matrix in the storage order of Mat4, for normals. */
+typedef struct {
+    GLfloat m[9];
+} Mat3;
+
+#ifdef MATRIX_COLUMN_MAJOR
+#define MATRIX_TRANSPOSE GL_FALSE
+#define MAT4_INDEX(row, column) ((column) * 4 + (row))
+#define MAT3_INDEX(row, column) ((column) * 3 + (row))
+#else
+#define MATRIX_TRANSPOSE GL_TRUE
+#define MAT4_INDEX(row, column) ((row) * 4 + (column))
+#define MAT3_INDEX(row, column) ((row) * 3 + (column))
+#endif
+
+#define MAT4_AT(matrix, row, column) ((matrix)->m[MAT4_INDEX(row, column)])
+#define MAT3_AT(matrix, row, column) ((matrix)->m[MAT3_INDEX(row, column)])
+
+/* What a matrix is known to be, from the cheapest to invert to the dearest. Products have 
+ * the larger kind of their factors. */
+enum TransformKind {
+    TRANSFORM_RIGID,         /* rotation and translation */
+    TRANSFORM_UNIFORM_SCALE, /* rigid with one scale for all axes */
+    TRANSFORM_AFFINE,        /* the bottom row is 0 0 0 1 */
+    TRANSFORM_GENERAL,
+};
+
+extern void mat4OfPerspective(Mat4 * matrix,
+    GLfloat l, GLfloat r, GLfloat b, GLfloat t, GLfloat n, GLfloat f);
+extern void mat4OfIdentity(Mat4 * matrix);
+extern void mat4OfScale(Mat4 * matrix, GLfloat sx, GLfloat sy, GLfloat sz);
+extern void mat4OfTranslation(Mat4 * matrix, GLfloat dx, GLfloat dy, GLfloat dz);
+extern void mat4OfRotationX(Mat4 * matrix, GLfloat angle);
+extern void mat4OfRotationY(Mat4 * matrix, GLfloat angle);
+extern void mat4OfRotationZ(Mat4 * matrix, GLfloat angle);
+
+/* Writes T R S in one pass, with R rotating about X, then Y, then Z by angles, or by the
+ * unit quaternion (x y z w) for the quaternion version. Returns the kind of the result. */
+extern enum TransformKind mat4OfTrs(Mat4 * matrix, const GLfloat * translation,
+    const GLfloat * angles, const GLfloat * scale);
+extern enum TransformKind mat4OfTrsQuaternion(Mat4 * matrix, const GLfloat * translation,
+    const GLfloat * rotation, const GLfloat * scale);
+
+/* out may alias a or b. Products match matrixMultiplymm bit for bit. */
+extern void mat4Multiply(Mat4 * out, const Mat4 * a, const Mat4 * b);
+
+/* Products with a factor of known structure, which skip the terms its zeros and ones make
+ * trivial. Each matches mat4Multiply with the full factor bit for bit, for finite values 
+ * and up to the sign of zero. The first ones multiply matrix on the right in place. */
+extern void mat4Translate(Mat4 * matrix, GLfloat dx, GLfloat dy, GLfloat dz);
+extern void mat4Scale(Mat4 * matrix, GLfloat sx, GLfloat sy, GLfloat sz);
+extern void mat4RotateX(Mat4 * matrix, GLfloat angle);
+extern void mat4RotateY(Mat4 * matrix, GLfloat angle);
+extern void mat4RotateZ(Mat4 * matrix, GLfloat angle);
+extern void mat4MultiplyAffine(Mat4 * out, const Mat4 * a, const Mat4 * b);
+/* perspective as from mat4OfPerspective, out may alias b */
+extern void mat4MultiplyPerspective(Mat4 * out, const Mat4 * perspective, const Mat4 * b);
+
+extern void mat4Transpose(Mat4 * out, const Mat4 * in);
+extern int mat4Inverse(Mat4 * out, const Mat4 * in);
+
+/* Like mat4Inverse, but trusts kind to skip the terms it makes constant. */
+extern int mat4InverseOfKind(Mat4 * out, const Mat4 * in, enum TransformKind kind);
+
+/* The inverse transpose of the upper 3x3 of in, which transforms normals. If that is 
+ * singular, writes the identity instead and returns nonzero. */
+extern int mat4NormalMatrix(Mat3 * out, const Mat4 * in, enum TransformKind kind);
+
+/* Transforms count vectors of 4 floats, out may alias vectors. */
+extern void mat4TransformVectors(GLfloat * out, const Mat4 * matrix, const GLfloat * vectors,
+    unsigned long count);
+
+/* Transforms of count objects as one array per component. Each object is scaled, then 
+ * rotated, then translated. Rotations are unit quaternions (x y z w) in rotation or, if 
+ * rotation[0] is NULL, Euler angles in angles as for mat4OfTrs. */
+struct TransformArrays {
+    unsigned long count;
+    const GLfloat * translation[3];
+    const GLfloat * rotation[4];
+    const GLfloat * angles[3];
+    const GLfloat * scale[3];
+};
+
+/* Writes view times the matrix of each object to modelViews and, unless normalMatrices is 
+ * NULL, the normal matrix of that to normalMatrices. view must be affine, an identity view 
+ * gives the batch version of mat4OfTrs. Large batches are split across threads. */
+extern void composeTransforms(Mat4 * modelViews, Mat3 * normalMatrices, const Mat4 * view,
+    const struct TransformArrays * objects);
+
+/* The planes a x + b y + c z + d = 0 that bound the clip volume of a matrix, left, right,
+ * bottom, top, near and far, normalized and facing in. Those of projection * view are in 
+ * world space. */
+struct Frustum {
+    GLfloat planes[6][4];
+};
+
+extern void frustumOfMatrix(struct Frustum * frustum, const Mat4 * matrix);
+
+/* Bounding spheres of count objects as one array per component. */
+struct BoundingSpheres {
+    unsigned long count;
+    const GLfloat * center[3];
+    const GLfloat * radius;
+};
+
+/* Writes the indices of the spheres that reach into frustum to visible in increasing 
+ * order, returns how many there are. visible needs room for all the spheres. Large 
+ * batches are split across the parallelFor workers. Only spheres are tested, there is
+ * no box test. On one core at the AVX-512 level a sphere takes about 1 ns in cache and
+ * 2.2 ns out of it, so 1M objects take about 2.4 ms there; bench_math reports the time
+ * of such a frame on all processors. */
+extern unsigned long cullSpheres(GLuint * visible, const struct Frustum * frustum,
+    const struct BoundingSpheres * spheres);
+
+/* Binds the matrix kernels to their variants for level, which happens at startup for 
+ * cpuLevel(). Not thread safe, for benchmarks that compare the variants. */
+extern void bindGeometryKernels(enum CpuLevel level);
@@ -0,0 +1,228 @@
+/* The batch kernels of composeTransforms and cullSpheres, written once over Lanes, 
+ * LANES floats of a vector register. geometry.c includes this once per register width 
+ * with the Lanes macros defined and LANES_NAME suffixing the names by width. */
+
+#define lanesRound LANES_NAME(lanesRound)
+#define lanesSinCos LANES_NAME(lanesSinCos)
+#define composeLanes LANES_NAME(composeLanes)
+#define composeObjects LANES_NAME(composeObjects)
+#define planeDistance LANES_NAME(planeDistance)
+#define cullObjects LANES_NAME(cullObjects)
+
+/* Rounds to the nearest integer for |x| < 2^22: adding 1.5 * 2^23 leaves no bits for a 
+ * fraction. */
+static Lanes
+lanesRound(Lanes x) {
+    Lanes magic = lanesSet(12582912.f);
+    return lanesSub(lanesAdd(x, magic), magic);
+}
+
+/* Reduces x by the nearest multiple q of pi/2 in three parts, evaluates the sinf and cosf
+ * polynomials of Cephes on the rest and picks signs and order by q mod 4. Accurate for 
+ * |x| up to some thousands, which is plenty for angles. */
+static void
+lanesSinCos(Lanes x, Lanes * sine, Lanes * cosine) {
+    Lanes q = lanesRound(lanesMul(x, lanesSet(0.636619772f)));
+    Lanes r = lanesSub(x, lanesMul(q, lanesSet(1.5703125f)));
+    r = lanesSub(r, lanesMul(q, lanesSet(4.837512969970703125e-4f)));
+    r = lanesSub(r, lanesMul(q, lanesSet(7.54978995489188216e-8f)));
+    Lanes r2 = lanesMul(r, r);
+    Lanes s = lanesAdd(lanesSet(8.3321608736e-3f), lanesMul(r2, lanesSet(-1.9515295891e-4f)));
+    s = lanesAdd(lanesSet(-1.6666654611e-1f), lanesMul(r2, s));
+    s = lanesAdd(r, lanesMul(lanesMul(r, r2), s));
+    Lanes c = lanesAdd(lanesSet(-1.388731625493765e-3f), 
+        lanesMul(r2, lanesSet(2.443315711809948e-5f)));
+    c = lanesAdd(lanesSet(4.166664568298827e-2f), lanesMul(r2, c));
+    c = lanesAdd(lanesSub(lanesSet(1), lanesMul(r2, lanesSet(0.5f))), 
+        lanesMul(lanesMul(r2, r2), c));
+    /* q mod 4 is 2 b1 + b0, b0 swaps sine and cosine, b1 negates the sine and b0 xor b1 
+     * the cosine. */
+    Lanes turns = lanesRound(lanesSub(lanesMul(q, lanesSet(0.25f)), lanesSet(0.375f)));
+    Lanes quadrant = lanesSub(q, lanesMul(lanesSet(4), turns));
+    Lanes b1 = lanesRound(lanesSub(lanesMul(quadrant, lanesSet(0.5f)), lanesSet(0.25f)));
+    Lanes b0 = lanesSub(quadrant, lanesAdd(b1, b1));
+    Lanes one = lanesSet(1), two = lanesSet(2);
+    Lanes sineSign = lanesSub(one, lanesMul(two, b1));
+    Lanes cosineSign = lanesSub(one, lanesMul(two, 
+        lanesSub(lanesAdd(b0, b1), lanesMul(two, lanesMul(b0, b1)))));
+    *sine = lanesMul(sineSign, lanesAdd(s, lanesMul(b0, lanesSub(c, s))));
+    *cosine = lanesMul(cosineSign, lanesAdd(c, lanesMul(b0, lanesSub(s, c))));
+}
+
+/* Composes the LANES objects from offset into one row of lanes per element, in storage 
+ * order, given the view v and its normal matrix n, NULL to skip normals. The normal 
+ * matrix of a model-view V R S is N R S^-1, with N that of V. */
+static void
+composeLanes(GLfloat (*modelViews)[LANES], GLfloat (*normals)[LANES], 
+        Lanes (*v)[4], Lanes (*n)[3], const GLfloat * const * components, 
+        unsigned long offset, int euler) {
+    Lanes t[3], s[3], r[3][3];
+    for (int i = 0; i < 3; ++i) {
+        t[i] = lanesLoad(components[i] + offset);
+        s[i] = lanesLoad(components[7 + i] + offset);
+    }
+    if (euler) {
+        Lanes sx, cx, sy, cy, sz, cz;
+        lanesSinCos(lanesLoad(components[3] + offset), &sx, &cx);
+        lanesSinCos(lanesLoad(components[4] + offset), &sy, &cy);
+        lanesSinCos(lanesLoad(components[5] + offset), &sz, &cz);
+        Lanes sxsy = lanesMul(sx, sy), cxsy = lanesMul(cx, sy);
+        r[0][0] = lanesMul(cy, cz);
+        r[0][1] = lanesSub(lanesMul(sxsy, cz), lanesMul(cx, sz));
+        r[0][2] = lanesAdd(lanesMul(cxsy, cz), lanesMul(sx, sz));
+        r[1][0] = lanesMul(cy, sz);
+        r[1][1] = lanesAdd(lanesMul(sxsy, sz), lanesMul(cx, cz));
+        r[1][2] = lanesSub(lanesMul(cxsy, sz), lanesMul(sx, cz));
+        r[2][0] = lanesSub(lanesSet(0), sy);
+        r[2][1] = lanesMul(sx, cy);
+        r[2][2] = lanesMul(cx, cy);
+    } else {
+        Lanes q[4];
+        for (int i = 0; i < 4; ++i) q[i] = lanesLoad(components[3 + i] + offset);
+        Lanes one = lanesSet(1);
+        Lanes x2 = lanesAdd(q[0], q[0]), y2 = lanesAdd(q[1], q[1]);
+        Lanes z2 = lanesAdd(q[2], q[2]);
+        Lanes xx = lanesMul(q[0], x2), yy = lanesMul(q[1], y2), zz = lanesMul(q[2], z2);
+        Lanes xy = lanesMul(q[0], y2), xz = lanesMul(q[0], z2), yz = lanesMul(q[1], z2);
+        Lanes wx = lanesMul(q[3], x2), wy = lanesMul(q[3], y2), wz = lanesMul(q[3], z2);
+        r[0][0] = lanesSub(one, lanesAdd(yy, zz));
+        r[0][1] = lanesSub(xy, wz);
+        r[0][2] = lanesAdd(xz, wy);
+        r[1][0] = lanesAdd(xy, wz);
+        r[1][1] = lanesSub(one, lanesAdd(xx, zz));
+        r[1][2] = lanesSub(yz, wx);
+        r[2][0] = lanesSub(xz, wy);
+        r[2][1] = lanesAdd(yz, wx);
+        r[2][2] = lanesSub(one, lanesAdd(xx, yy));
+    }
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            Lanes sum = lanesMul(v[i][0], r[0][j]);
+            sum = lanesAdd(sum, lanesMul(v[i][1], r[1][j]));
+            sum = lanesAdd(sum, lanesMul(v[i][2], r[2][j]));
+            lanesStore(modelViews[MAT4_INDEX(i, j)], lanesMul(sum, s[j]));
+        }
+        Lanes sum = lanesMul(v[i][0], t[0]);
+        sum = lanesAdd(sum, lanesMul(v[i][1], t[1]));
+        sum = lanesAdd(sum, lanesMul(v[i][2], t[2]));
+        lanesStore(modelViews[MAT4_INDEX(i, 3)], lanesAdd(sum, v[i][3]));
+    }
+    if (!n) return;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            Lanes sum = lanesMul(n[i][0], r[0][j]);
+            sum = lanesAdd(sum, lanesMul(n[i][1], r[1][j]));
+            sum = lanesAdd(sum, lanesMul(n[i][2], r[2][j]));
+            lanesStore(normals[MAT3_INDEX(i, j)], lanesDiv(sum, s[j]));
+        }
+    }
+}
+
+static void
+composeObjects(void * context, unsigned long begin, unsigned long end) {
+    struct Composition * composition = context;
+    GLfloat modelViews[16][LANES], normals[9][LANES];
+    Lanes view[4][4], viewNormal[3][3];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) view[i][j] = lanesSet(composition->view[i][j]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            viewNormal[i][j] = lanesSet(composition->viewNormal[i][j]);
+        }
+    }
+    Lanes (*n)[3] = composition->normalMatrices ? viewNormal : NULL;
+    for (unsigned long i = begin * OBJECTS_PER_TASK; 
+            i < end * OBJECTS_PER_TASK && i < composition->count; i += LANES) {
+        unsigned long count = composition->count - i < LANES ? composition->count - i : LANES;
+        if (LANES == count) {
+            composeLanes(modelViews, normals, view, n, composition->components, i, 
+                composition->euler);
+        } else {
+            /* The last objects are padded with identities */
+            static const GLfloat identity[10] = { 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 };
+            GLfloat padded[10][LANES];
+            const GLfloat * components[10];
+            for (int k = 0; k < 10; ++k) {
+                components[k] = padded[k];
+                if (!composition->components[k]) continue;
+                for (unsigned long l = 0; l < LANES; ++l) {
+                    padded[k][l] = l < count ? composition->components[k][i + l] : identity[k];
+                }
+            }
+            composeLanes(modelViews, normals, view, n, components, 0, composition->euler);
+        }
+        for (unsigned long l = 0; l < count; ++l) {
+            GLfloat * modelView = composition->modelViews[i + l].m;
+            for (int k = 0; k < 16; ++k) modelView[k] = modelViews[k][l];
+            if (!composition->normalMatrices) continue;
+            GLfloat * normal = composition->normalMatrices[i + l].m;
+            for (int k = 0; k < 9; ++k) normal[k] = normals[k][l];
+        }
+    }
+}
+
+/* How far spheres reach to the inner side of a plane, in the order of sphereReaches */
+static Lanes
+planeDistance(const Lanes * plane, Lanes x, Lanes y, Lanes z, Lanes r) {
+    Lanes distance = lanesAdd(lanesMul(plane[0], x), lanesMul(plane[1], y));
+    distance = lanesAdd(distance, lanesMul(plane[2], z));
+    return lanesAdd(lanesAdd(distance, plane[3]), r);
+}
+
+/* Culls the spheres of the tasks from begin to end. The visible ones of a task go to 
+ * visible from its first index on, the caller closes the gaps. */
+static void
+cullObjects(void * context, unsigned long begin, unsigned long end) {
+    struct Culling * culling = context;
+    const struct BoundingSpheres * spheres = culling->spheres;
+    Lanes planes[6][4];
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 4; ++j) planes[i][j] = lanesSet(culling->planes[i][j]);
+    }
+    for (unsigned long task = begin; task < end; ++task) {
+        unsigned long first = task * OBJECTS_PER_TASK;
+        unsigned long last = spheres->count - first < OBJECTS_PER_TASK ? 
+            spheres->count : first + OBJECTS_PER_TASK;
+        GLuint * visible = culling->visible + first;
+        unsigned long numberOfVisible = 0, i = first;
+        for (; i + LANES <= last; i += LANES) {
+            Lanes x = lanesLoad(spheres->center[0] + i);
+            Lanes y = lanesLoad(spheres->center[1] + i);
+            Lanes z = lanesLoad(spheres->center[2] + i);
+            Lanes r = lanesLoad(spheres->radius + i);
+            Lanes nearest = planeDistance(planes[0], x, y, z, r);
+            for (int p = 1; p < 6; ++p) {
+                nearest = lanesMin(nearest, planeDistance(planes[p], x, y, z, r));
+            }
+            unsigned long mask = lanesNonNegative(nearest);
+            while (mask) {
+                visible[numberOfVisible++] = i + __builtin_ctzl(mask);
+                mask &= mask - 1;
+            }
+        }
+        for (; i < last; ++i) {
+            if (sphereReaches(culling, i)) visible[numberOfVisible++] = i;
+        }
+        culling->counts[task] = numberOfVisible;
+    }
+}
+
+#undef lanesRound
+#undef lanesSinCos
+#undef composeLanes
+#undef composeObjects
+#undef planeDistance
+#undef cullObjects
+#undef LANES
+#undef LANES_NAME
+#undef Lanes
+#undef lanesLoad
+#undef lanesStore
+#undef lanesSet
+#undef lanesAdd
+#undef lanesSub
+#undef lanesMul
+#undef lanesDiv
+#undef lanesMin
+#undef lanesNonNegative
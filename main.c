@@ -6,11 +6,16 @@
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "utils.h"
+#include "fileio.h"
+#include "assetpack.h"
+#include "cpu.h"
 #include "geometry.h"
 #include "mesh.h"
+#include "scene.h"
+#include "renderqueue.h"
+#include "texture.h"
+#include "uniforms.h"
 
 static struct Rect {
     int width;
@@ -24,35 +29,63 @@ static struct Mesh africanHead;
 static struct Mesh monkey;
 static struct Mesh sphere;
 
+/* In vertices, room for the models with some to spare. */
+#define GEOMETRY_ARENA_CAPACITY (1 << 16)
+
+static struct GeometryArena geometryArena;
+
 static struct {
     GLuint id;
-    GLuint modelViewInverseTransposeLocation;
-    GLuint modelViewLocation;
-    GLuint projectionLocation;
     GLuint textureLocation;
-    GLuint materialAmbientLocation;
-    GLuint materialDiffuseLocation;
-    GLuint materialSpecularLocation;
-    GLuint materialShininessLocation;
-    GLuint lightPosLocation;
+    GLuint instancesLocation;
 } solidShader;
 
+/* The uniform blocks of solid.vert in std140 layout, which pads a vec3 to four floats.
+ * Matrices are column-major there. */
+#define FRAME_BLOCK_BINDING 0
+#define DRAW_BLOCK_BINDING 1
+
+struct FrameUniforms {
+    GLfloat projection[16];
+    GLfloat lightPos[4];
+};
+
+/* std140 rounds the size of a block up to that of a vec4, so a range of it must be too */
+struct DrawUniforms {
+    GLint firstInstance; /* texel of the first instance of the draw */
+    GLint padding[3];
+};
+
+/* An instance as solid.vert fetches it from the instance buffer texture, ten RGBA texels
+ * for the columns of the matrices and the material. */
+#define TEXELS_PER_INSTANCE 10
+#define INSTANCE_TEXTURE_UNIT 1
+
+struct Instance {
+    GLfloat modelView[16];
+    GLfloat normalMatrix[3][4];
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[3];
+    GLfloat shininess;
+};
+
+static struct UniformRing uniformRing;
+static struct UniformRing instanceRing;
+static GLuint instanceTexture;
+
 #define PI (atan(1.) * 4.)
 
 static GLuint
-compileShaderFile(const char * shaderFilePath, GLenum shaderType) {
-    GLchar * shaderSource = loadFile(shaderFilePath);
+compileShaderSource(const GLchar * shaderSource, GLenum shaderType) {
     GLuint shaderId = glCreateShader(shaderType);
-    glShaderSource(shaderId, 1, (const GLchar * const *)&shaderSource, NULL);
+    glShaderSource(shaderId, 1, &shaderSource, NULL);
     glCompileShader(shaderId);
-    free(shaderSource);
     return shaderId;
 }
 
 static GLint
-compileShader(const char * vertexShaderPath, const char * fragmentShaderPath) {
-    GLuint vertexShader = compileShaderFile(vertexShaderPath, GL_VERTEX_SHADER);
-    GLuint fragmentShader = compileShaderFile(fragmentShaderPath, GL_FRAGMENT_SHADER);
+linkShader(GLuint vertexShader, GLuint fragmentShader) {
     GLuint shaderProgram = glCreateProgram();
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
@@ -68,27 +101,76 @@ debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
     printf("opengl log: %s\n", message);
 }
 
-static GLfloat modelView[16];
-static GLfloat projection[16];
+static Mat4 projection;
+static struct Scene scene;
 
-static GLuint
-loadTexture(char * filePath) {
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    int width, height, channels;
-    GLchar * data = (GLchar *)stbi_load(filePath, &width, &height, &channels, 3);
-    if (!data) exit(1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    return texture;
+static struct {
+    char * objFilePath;
+    char * textureFilePath;
+    struct Mesh * mesh;
+    GLfloat position[3];
+    GLfloat size;
+    GLfloat radius; /* of a sphere about the origin of the mesh that bounds it */
+} models[] = {
+    { "african_head.obj", "african_head_diffuse.tga", &africanHead, {-1,   1, -2}, 1,  1.05 },
+    { "monkey.obj",       "monkey_diffuse.png",       &monkey,      { 1,   1, -2}, .8, 1.49 },
+    { "sphere.obj",       "sphere_diffuse.png",       &sphere,      { 0, -.8, -2}, 1,  0.94 },
+};
+
+#define NUMBER_OF_MODELS (sizeof(models) / sizeof(models[0]))
+
+static unsigned long modelNodes[NUMBER_OF_MODELS];
+static GLfloat boundingSphereComponents[4][NUMBER_OF_MODELS];
+static GLuint visibleModels[NUMBER_OF_MODELS];
+
+/* The visible models of a mesh are drawn as the instances of one draw. */
+static struct Batch {
+    struct Mesh * mesh;
+    GLsizei firstInstance;
+    GLsizei numberOfInstances;
+    GLintptr uniformOffset;
+} batches[NUMBER_OF_MODELS];
+static unsigned meshIdentifiers[NUMBER_OF_MODELS]; /* the first model with the mesh */
+static struct RenderQueue renderQueue;
+
+#define OPAQUE_PASS 0
+#define FAR_DISTANCE 100
+
+/* Shaders and textures are read in one batch, see readFiles, and each is compiled or 
+ * uploaded as soon as its read is done. The meshes stream in on threads of their own 
+ * meanwhile, so they get their textures once those arrive. */
+static void
+startupFileRead(struct FileRead * read, unsigned long index, void * context) {
+    GLuint * shaders = context;
+    if (!read->content) exit(1);
+    if (index < 2) {
+        shaders[index] = compileShaderSource(read->content, 
+            index ? GL_FRAGMENT_SHADER : GL_VERTEX_SHADER);
+    } else {
+        models[index - 2].mesh->texture = createTextureFromFile(
+            models[index - 2].textureFilePath, read->content, read->size);
+    }
+    free(read->content);
 }
 
-static struct Mesh
-loadModel(char * objFilePath, char * textureFilePath) {
-    return createMeshFromObj(objFilePath, loadTexture(textureFilePath));
+static void
+loadStartupFiles(void) {
+    openAssetPack("assets.pack");
+    meshLoaderOptions.useCache = 1;
+    createGeometryArena(&geometryArena, GEOMETRY_ARENA_CAPACITY);
+    meshLoaderOptions.arena = &geometryArena;
+    struct FileRead reads[2 + NUMBER_OF_MODELS] = {
+        { .filepath = "solid.vert" },
+        { .filepath = "solid.frag" },
+    };
+    for (unsigned i = 0; i < NUMBER_OF_MODELS; ++i) {
+        *models[i].mesh = streamMeshFromObj(models[i].objFilePath, 0);
+        reads[2 + i].filepath = textureFileOf(models[i].textureFilePath);
+    }
+    GLuint shaders[2];
+    readFiles(reads, 2 + NUMBER_OF_MODELS, startupFileRead, shaders);
+    for (unsigned i = 0; i < NUMBER_OF_MODELS; ++i) free((char *)reads[2 + i].filepath);
+    solidShader.id = linkShader(shaders[0], shaders[1]);
 }
 
 static void
@@ -96,23 +178,21 @@ initOpengl(void) {
     glEnable(GL_DEPTH_TEST);
     glDebugMessageCallback(debugCallback, NULL);
     glClearColor(0, 0, 0, 1);
-    solidShader.id = compileShader("solid.vert", "solid.frag");
-    solidShader.modelViewInverseTransposeLocation = 
-        glGetUniformLocation(solidShader.id, "modelViewInverseTranspose");
-    solidShader.modelViewLocation = glGetUniformLocation(solidShader.id, "modelView");
-    solidShader.projectionLocation = glGetUniformLocation(solidShader.id, "projection");
+    loadStartupFiles();
     solidShader.textureLocation = glGetUniformLocation(solidShader.id, "texture");
-    solidShader.materialAmbientLocation = glGetUniformLocation(solidShader.id, "material.ambient");
-    solidShader.materialDiffuseLocation = glGetUniformLocation(solidShader.id, "material.diffuse");
-    solidShader.materialSpecularLocation = 
-        glGetUniformLocation(solidShader.id, "material.specular");
-    solidShader.materialShininessLocation = 
-        glGetUniformLocation(solidShader.id, "material.shininess");
-    solidShader.lightPosLocation = glGetUniformLocation(solidShader.id, "lightPos");
-    matrixOfPerspective(projection, -1, 1, -1, 1, 1, 100);
-    africanHead = loadModel("african_head.obj", "african_head_diffuse.tga");
-    monkey = loadModel("monkey.obj", "monkey_diffuse.png");
-    sphere = loadModel("sphere.obj", "sphere_diffuse.png");
+    solidShader.instancesLocation = glGetUniformLocation(solidShader.id, "instances");
+    glUniformBlockBinding(solidShader.id, glGetUniformBlockIndex(solidShader.id, "Frame"),
+        FRAME_BLOCK_BINDING);
+    glUniformBlockBinding(solidShader.id, glGetUniformBlockIndex(solidShader.id, "Draw"),
+        DRAW_BLOCK_BINDING);
+    createUniformRing(&uniformRing, sizeof(struct FrameUniforms), 1 + NUMBER_OF_MODELS);
+    createUniformRing(&instanceRing, NUMBER_OF_MODELS * sizeof(struct Instance), 1);
+    glGenTextures(1, &instanceTexture);
+    glActiveTexture(GL_TEXTURE0 + INSTANCE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceRing.buffer);
+    glActiveTexture(GL_TEXTURE0);
+    mat4OfPerspective(&projection, -1, 1, -1, 1, 1, FAR_DISTANCE);
     for (int i = 0; i < 3; ++i) {
         africanHead.material.ambient[i] = 0;
         monkey.material.diffuse[i] = 0;
@@ -120,63 +200,121 @@ initOpengl(void) {
     }
 }
 
+/* The models do not move, so their matrices are computed by the first updateScene. */
 static void
-loadIdentity() {
-    matrixOfIdentity(modelView);
+placeModels(void) {
+    initScene(&scene);
+    for (unsigned i = 0; i < NUMBER_OF_MODELS; ++i) {
+        GLfloat angles[] = { 0, 0, 0 };
+        GLfloat scale[] = { models[i].size, models[i].size, models[i].size };
+        modelNodes[i] = addSceneNode(&scene, NO_PARENT);
+        setSceneNodeTransform(&scene, modelNodes[i], models[i].position, angles, scale);
+        meshIdentifiers[i] = 0;
+        while (models[meshIdentifiers[i]].mesh != models[i].mesh) ++meshIdentifiers[i];
+    }
+    initRenderQueue(&renderQueue);
 }
 
 static void
-translate(GLfloat dx, GLfloat dy, GLfloat dz) {
-    GLfloat t[16];
-    matrixOfTranslation(t, dx, dy, dz);
-    matrixMultiplymm(modelView, modelView, t);
+storeColumnMajor(GLfloat * columns, const Mat4 * matrix) {
+    for (int j = 0; j < 4; ++j) {
+        for (int i = 0; i < 4; ++i) columns[j * 4 + i] = MAT4_AT(matrix, i, j);
+    }
 }
 
-#if 0
-
 static void
-rotateX(GLfloat angle) {
-    GLfloat t[16];
-    matrixOfRotationX(t, angle);
-    matrixMultiplymm(modelView, modelView, t);
+storeInstance(struct Instance * instance, const struct Material * material,
+        unsigned long node) {
+    Mat4 * modelView = &scene.worlds[node];
+    storeColumnMajor(instance->modelView, modelView);
+    Mat3 normal;
+    mat4NormalMatrix(&normal, modelView, scene.kinds[node]);
+    for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < 3; ++i) instance->normalMatrix[j][i] = MAT3_AT(&normal, i, j);
+        instance->normalMatrix[j][3] = 0;
+    }
+    memcpy(instance->ambient, material->ambient, sizeof(material->ambient));
+    memcpy(instance->diffuse, material->diffuse, sizeof(material->diffuse));
+    memcpy(instance->specular, material->specular, sizeof(material->specular));
+    instance->ambient[3] = instance->diffuse[3] = 0;
+    instance->shininess = material->shininess;
 }
 
-static void
-rotateY(GLfloat angle) {
-    GLfloat t[16];
-    matrixOfRotationY(t, angle);
-    matrixMultiplymm(modelView, modelView, t);
+/* Sorts the visible models by the state they are drawn with, then by distance, and
+ * cuts runs of the same mesh into batches, whose instances are thus front to back. 
+ * With no camera, the distance is the depth of the model in world space. Returns the
+ * number of batches. All keys of a mesh differ only in depth, so each mesh must come
+ * out as a single batch, which is checked as the batches are cut. */
+static unsigned long
+batchVisibleModels(unsigned long numberOfVisibleModels) {
+    clearRenderQueue(&renderQueue);
+    for (unsigned long i = 0; i < numberOfVisibleModels; ++i) {
+        unsigned model = visibleModels[i];
+        GLfloat depth = -MAT4_AT(&scene.worlds[modelNodes[model]], 2, 3) / FAR_DISTANCE;
+        pushRenderItem(&renderQueue, renderKey(OPAQUE_PASS, solidShader.id, 
+            models[model].mesh->texture, 0, meshIdentifiers[model], depth), model);
+    }
+    sortRenderQueue(&renderQueue);
+    unsigned long numberOfBatches = 0;
+    for (unsigned long i = 0; i < renderQueue.numberOfItems; ++i) {
+        struct Mesh * mesh = models[renderQueue.items[i].payload].mesh;
+        if (!numberOfBatches || batches[numberOfBatches - 1].mesh != mesh) {
+            for (unsigned long b = 0; b < numberOfBatches; ++b) {
+                if (batches[b].mesh != mesh) continue;
+                printf("Model %lu was sorted apart from the copies of its mesh\n",
+                    renderQueue.items[i].payload);
+                exit(1);
+            }
+            batches[numberOfBatches++] = (struct Batch){ .mesh = mesh, .firstInstance = i };
+        }
+        ++batches[numberOfBatches - 1].numberOfInstances;
+    }
+    return numberOfBatches;
 }
 
+/* Stores the instances of the queued models in queue order in the instance ring and
+ * one draw block per batch in the uniform ring. */
 static void
-rotateZ(GLfloat angle) {
-    GLfloat t[16];
-    matrixOfRotationZ(t, angle);
-    matrixMultiplymm(modelView, modelView, t);
+pushInstances(unsigned long numberOfBatches) {
+    GLintptr offset;
+    struct Instance * instances = reserveUniforms(&instanceRing,
+        renderQueue.numberOfItems * sizeof(struct Instance), &offset);
+    for (unsigned long i = 0; i < numberOfBatches; ++i) {
+        struct DrawUniforms uniforms = {
+            .firstInstance = offset / (4 * sizeof(GLfloat)) + 
+                batches[i].firstInstance * TEXELS_PER_INSTANCE
+        };
+        batches[i].uniformOffset = pushUniforms(&uniformRing, &uniforms, sizeof(uniforms));
+    }
+    for (unsigned long i = 0; i < renderQueue.numberOfItems; ++i) {
+        unsigned long model = renderQueue.items[i].payload;
+        storeInstance(&instances[i], &models[model].mesh->material, modelNodes[model]);
+    }
 }
 
-#endif
-
 static void
-scale(GLfloat sx, GLfloat sy, GLfloat sz) {
-    GLfloat t[16];
-    matrixOfScale(t, sx, sy, sz);
-    matrixMultiplymm(modelView, modelView, t);
+drawBatch(struct Batch * batch) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING, uniformRing.buffer,
+        batch->uniformOffset, sizeof(struct DrawUniforms));
+    drawMesh(*batch->mesh, batch->numberOfInstances);
 }
 
-static void
-drawModel(struct Mesh mesh) {
-    glUniformMatrix4fv(solidShader.modelViewLocation, 1, GL_TRUE, modelView);
-    GLfloat modelViewInverseTranspose[16];
-    matrixInverse(modelViewInverseTranspose, modelView);
-    matrixTranspose(modelViewInverseTranspose, modelViewInverseTranspose);
-    glUniformMatrix4fv(solidShader.modelViewInverseTransposeLocation, 1, GL_TRUE, 
-        modelViewInverseTranspose);
-    glUniform3fv(solidShader.materialAmbientLocation, 1, mesh.material.ambient);
-    glUniform3fv(solidShader.materialDiffuseLocation, 1, mesh.material.diffuse);
-    glUniform3fv(solidShader.materialSpecularLocation, 1, mesh.material.specular);
-    glUniform1f(solidShader.materialShininessLocation, mesh.material.shininess);
-    drawMesh(mesh);
+/* The bounding spheres of the models follow their world matrices. There is no camera,
+ * so the view is the identity and the frustum of the projection alone is in world 
+ * space. */
+static unsigned long
+cullModels(void) {
+    struct BoundingSpheres spheres = { .count = NUMBER_OF_MODELS };
+    for (unsigned i = 0; i < NUMBER_OF_MODELS; ++i) {
+        Mat4 * world = &scene.worlds[modelNodes[i]];
+        for (int j = 0; j < 3; ++j) boundingSphereComponents[j][i] = MAT4_AT(world, j, 3);
+        boundingSphereComponents[3][i] = models[i].radius * models[i].size;
+    }
+    for (int j = 0; j < 3; ++j) spheres.center[j] = boundingSphereComponents[j];
+    spheres.radius = boundingSphereComponents[3];
+    struct Frustum frustum;
+    frustumOfMatrix(&frustum, &projection);
+    return cullSpheres(visibleModels, &frustum, &spheres);
 }
 
 static GLfloat angle = 0;
@@ -186,22 +324,27 @@ display(void) {
     angle += 0.01;
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(solidShader.id);
-    glUniform3f(solidShader.lightPosLocation, 0, 0, 2 * cos(angle));
-    glUniformMatrix4fv(solidShader.projectionLocation, 1, GL_TRUE, projection);
     glUniform1i(solidShader.textureLocation, 0);
-    // Draw african head
-    loadIdentity();
-    translate(-1, 1, -2);
-    drawModel(africanHead);
-    // Draw monkey
-    loadIdentity();
-    translate(1, 1, -2);
-    scale(0.8, 0.8, 0.8);
-    drawModel(monkey);
-    // Draw sphere
-    loadIdentity();
-    translate(0, -0.8, -2);
-    drawModel(sphere);
+    glUniform1i(solidShader.instancesLocation, INSTANCE_TEXTURE_UNIT);
+    uploadStreamedBatches(&africanHead);
+    uploadStreamedBatches(&monkey);
+    uploadStreamedBatches(&sphere);
+    updateScene(&scene);
+    unsigned long numberOfVisibleModels = cullModels();
+    unsigned long numberOfBatches = batchVisibleModels(numberOfVisibleModels);
+    /* All uniforms of the frame are written first, as the rings are unmapped for drawing. */
+    beginUniformFrame(&uniformRing);
+    beginUniformFrame(&instanceRing);
+    struct FrameUniforms frameUniforms = { .lightPos = { 0, 0, 2 * cos(angle), 0 } };
+    storeColumnMajor(frameUniforms.projection, &projection);
+    GLintptr frameUniformOffset = 
+        pushUniforms(&uniformRing, &frameUniforms, sizeof(frameUniforms));
+    pushInstances(numberOfBatches);
+    endUniformFrame(&instanceRing);
+    endUniformFrame(&uniformRing);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, uniformRing.buffer,
+        frameUniformOffset, sizeof(frameUniforms));
+    for (unsigned long i = 0; i < numberOfBatches; ++i) drawBatch(&batches[i]);
     glutSwapBuffers();
 }
 
@@ -225,5 +368,6 @@ int main(int argc, char * argv[]) {
     glutIdleFunc(display);
     glutReshapeFunc(reshape);
     initOpengl();
+    placeModels();
     glutMainLoop();
 }
@@ -1,21 +1,60 @@
+#include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
+#include "cpu.h"
 #include "geometry.h"
 #include "mesh.h"
+#include "meshcodec.h"
 #include "utils.h"
 
+struct MeshLoaderOptions meshLoaderOptions;
+static struct MeshLoaderStatistics meshLoaderStatistics;
+
+/* Meshes in a geometry arena share its VAO, so it is only bound when it changes. All
+ * VAOs are bound through here to keep this up to date. */
+static GLuint boundVertexArray;
+
+static void
+bindVertexArray(GLuint vao) {
+    if (vao == boundVertexArray) return;
+    glBindVertexArray(vao);
+    boundVertexArray = vao;
+}
+
 extern void
-drawMesh(struct Mesh mesh) {
-    glBindVertexArray(mesh.vao);
+drawMesh(struct Mesh mesh, GLsizei numberOfInstances) {
     glBindTexture(GL_TEXTURE_2D, mesh.texture);
-    glDrawArrays(GL_TRIANGLES, 0, mesh.numberOfVertices);
+    if (mesh.indexBuffer) {
+        bindVertexArray(mesh.parts[0].vao);
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.numberOfIndices, mesh.indexType, 
+            (void *)mesh.indexOffset, numberOfInstances);
+        return;
+    }
+    for (unsigned long i = 0; i < mesh.numberOfParts; ++i) {
+        bindVertexArray(mesh.parts[i].vao);
+        glDrawArraysInstanced(GL_TRIANGLES, mesh.parts[i].firstVertex, 
+            mesh.parts[i].numberOfVertices, numberOfInstances);
+    }
 }
 
+static const struct Material defaultMaterial = {
+    .ambient = { 0.2, 0.2, 0.2 },
+    .diffuse = { 0.6, 0.6, 0.6 },
+    .specular = { 0.8, 0.8, 0.8 },
+    .shininess = 100,
+};
+
 struct FilePosition {
     unsigned long line;
     unsigned long column;
@@ -25,6 +64,34 @@ struct FilePosition {
 static char * fileContent;
 static struct FilePosition currentPosition, oldPosition;
 
+/* The parser keeps its cursor in globals, so files are parsed one at a time. */
+static pthread_mutex_t parserLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A loader lets go of the parser while it hands batches to a sink that may block, like
+ * a stream waiting for the GL thread, so that thread can still load files meanwhile.
+ * The cursor is saved and put back, since others may parse in between. */
+struct ParserState {
+    char * content;
+    struct FilePosition current;
+    struct FilePosition old;
+};
+
+static void
+suspendParser(struct ParserState * state) {
+    state->content = fileContent;
+    state->current = currentPosition;
+    state->old = oldPosition;
+    pthread_mutex_unlock(&parserLock);
+}
+
+static void
+resumeParser(const struct ParserState * state) {
+    pthread_mutex_lock(&parserLock);
+    fileContent = state->content;
+    currentPosition = state->current;
+    oldPosition = state->old;
+}
+
 #define peekChar() (fileContent[currentPosition.offset])
 
 static void
@@ -75,13 +142,103 @@ struct Face {
 #define skipSpaces() \
     do { while (isspace(peekChar()) && '\n' != peekChar()) consumeChar(); } while (0)
 
+/* Finds the newline or the terminating zero from p on. The vector variants load aligned
+ * blocks, which never reach into a page past the one of the terminating zero, and shift 
+ * the bytes before p out of the mask of the first block. */
+static const char *
+findLineEndScalar(const char * p) {
+    while ('\n' != *p && *p) ++p;
+    return p;
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE unsigned
+lineEndsSse(const char * block) {
+    __m128i bytes = _mm_load_si128((const __m128i *)block);
+    return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), 
+        _mm_cmpeq_epi8(bytes, _mm_setzero_si128())));
+}
+
+static CPU_TARGET_SSE const char *
+findLineEndSse(const char * p) {
+    const char * block = (const char *)((uintptr_t)p & ~(uintptr_t)15);
+    unsigned mask = lineEndsSse(block) >> (p - block);
+    if (mask) return p + __builtin_ctz(mask);
+    do { block += 16; } while (!(mask = lineEndsSse(block)));
+    return block + __builtin_ctz(mask);
+}
+
+static CPU_TARGET_AVX2 unsigned
+lineEndsAvx2(const char * block) {
+    __m256i bytes = _mm256_load_si256((const __m256i *)block);
+    return _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')), 
+        _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256())));
+}
+
+static CPU_TARGET_AVX2 const char *
+findLineEndAvx2(const char * p) {
+    const char * block = (const char *)((uintptr_t)p & ~(uintptr_t)31);
+    unsigned mask = lineEndsAvx2(block) >> (p - block);
+    if (mask) return p + __builtin_ctz(mask);
+    do { block += 32; } while (!(mask = lineEndsAvx2(block)));
+    return block + __builtin_ctz(mask);
+}
+
+static CPU_TARGET_AVX512 unsigned long long
+lineEndsAvx512(const char * block) {
+    __m512i bytes = _mm512_load_si512((const void *)block);
+    return _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8('\n')) 
+        | _mm512_cmpeq_epi8_mask(bytes, _mm512_setzero_si512());
+}
+
+static CPU_TARGET_AVX512 const char *
+findLineEndAvx512(const char * p) {
+    const char * block = (const char *)((uintptr_t)p & ~(uintptr_t)63);
+    unsigned long long mask = lineEndsAvx512(block) >> (p - block);
+    if (mask) return p + __builtin_ctzll(mask);
+    do { block += 64; } while (!(mask = lineEndsAvx512(block)));
+    return block + __builtin_ctzll(mask);
+}
+
+#endif
+
+/* Bound at startup by bindMeshKernels */
+static const char * (*findLineEnd)(const char * p) = findLineEndScalar;
+
+static void
+bindMeshKernels(enum CpuLevel level) {
+    findLineEnd = findLineEndScalar;
+#ifdef CPU_X86
+    if (CPU_SSE <= level) findLineEnd = findLineEndSse;
+    if (CPU_AVX2 <= level) findLineEnd = findLineEndAvx2;
+    if (CPU_AVX512 <= level) findLineEnd = findLineEndAvx512;
+#else
+    (void)level;
+#endif
+}
+
+static void __attribute__((constructor))
+bindMeshKernelsAtStartup(void) {
+    bindMeshKernels(cpuLevel());
+}
+
+/* Moves to the newline that ends the current line, which must have one. */
+static void
+skipToLineEnd(void) {
+    const char * begin = &fileContent[currentPosition.offset];
+    const char * end = findLineEnd(begin);
+    currentPosition.offset += end - begin;
+    currentPosition.column += end - begin;
+    if (!*end) error();
+}
+
 static void
 skipSpacesAndComments(void) {
     while (isspace(peekChar()) || '#' == peekChar()) {
         while (isspace(peekChar())) consumeChar(); 
-        if ('#' == peekChar()) {
-            while ('\n' != peekChar()) consumeChar();
-        }
+        if ('#' == peekChar()) skipToLineEnd();
     }
 }
 
@@ -93,12 +250,43 @@ accept(const char * line) {
     return result;
 }
 
+/* Exact powers of ten as floats, 5^10 still fits the 24 bits of a mantissa. */
+static const GLfloat powersOfTen[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 
+    1e8f, 1e9f, 1e10f };
+
+/* Parses the usual [-+]digits.digits of OBJ files without strtof when the digits make an
+ * integer m below 2^24 and there are at most 10 after the point. m and the power of ten 
+ * are then exact, so the one rounding of m / 10^k gives the very float strtof does. 
+ * Returns NULL for anything else, exponents and names included. */
+static const char *
+parseSimpleFloat(const char * p, GLfloat * out) {
+    int negative = '-' == *p;
+    if ('-' == *p || '+' == *p) ++p;
+    uint64_t m = 0;
+    int digits = 0, fractionDigits = 0;
+    for (; isdigit((unsigned char)*p) && digits < 19; ++p, ++digits) m = m * 10 + *p - '0';
+    if ('.' == *p) {
+        for (++p; isdigit((unsigned char)*p) && digits < 19; ++p, ++digits) {
+            m = m * 10 + *p - '0';
+            ++fractionDigits;
+        }
+    }
+    if (!digits || isalnum((unsigned char)*p) || '.' == *p || (1u << 24) < m 
+            || 10 < fractionDigits) return NULL;
+    GLfloat t = (GLfloat)m / powersOfTen[fractionDigits];
+    *out = negative ? -t : t;
+    return p;
+}
+
 static int
 parseFloat(GLfloat * out) {
     skipSpaces();
     char * endptr;
     char * beginptr = &fileContent[currentPosition.offset];
-    GLfloat t = (GLfloat)strtof(beginptr, &endptr);
+    GLfloat t;
+    const char * simpleEnd = parseSimpleFloat(beginptr, &t);
+    if (simpleEnd) endptr = (char *)simpleEnd;
+    else t = (GLfloat)strtof(beginptr, &endptr);
     if (out) *out = t;
     currentPosition.offset += endptr - beginptr;
     return endptr == beginptr;
@@ -142,6 +330,7 @@ parseTextureCoordinate(GLfloat * out) {
     if (parseFloat(out ? &out[1] : NULL)) error();
     parseFloat(NULL);
     if (accept("\n")) error();
+    if (out) out[2] = 0;
     return 0;
 }
 
@@ -188,10 +377,241 @@ parseFace(struct Face * out) {
         restorePosition();
         out->vertices = emalloc(out->numberOfVertices * sizeof(struct VertexAttributeIndices));
     }
-    for (int i = 0; !parseVertexAttributeIndices(out ? &out->vertices[i] : NULL); ++i);
+    for (unsigned i = 0; !parseVertexAttributeIndices(out ? &out->vertices[i] : NULL); ++i);
+    return 0;
+}
+
+/* Counts an attribute line without parsing it. Its content is checked when the second
+ * pass parses it. */
+static int
+countLine(const char * line) {
+    skipSpacesAndComments();
+    if (accept(line)) return 1;
+    skipToLineEnd();
+    if (accept("\n")) error();
+    return 0;
+}
+
+static int
+countFace(unsigned long * numberOfTriangles) {
+    skipSpacesAndComments();
+    if (accept("f")) return 1;
+    unsigned numberOfVertices = 0;
+    while (!parseVertexAttributeIndices(NULL)) ++numberOfVertices;
+    if (numberOfVertices < 3) error();
+    *numberOfTriangles += numberOfVertices - 2;
+    return 0;
+}
+
+/* Loaders report what they allocate here, from whatever thread they run on, so the 
+ * statistics show the current and peak memory of all loads in flight. */
+static pthread_mutex_t memoryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+trackMemory(size_t size) {
+    pthread_mutex_lock(&memoryLock);
+    meshLoaderStatistics.currentMemory += size;
+    if (meshLoaderStatistics.peakMemory < meshLoaderStatistics.currentMemory) {
+        meshLoaderStatistics.peakMemory = meshLoaderStatistics.currentMemory;
+    }
+    pthread_mutex_unlock(&memoryLock);
+}
+
+static void
+releaseMemory(size_t size) {
+    pthread_mutex_lock(&memoryLock);
+    meshLoaderStatistics.currentMemory -= size;
+    pthread_mutex_unlock(&memoryLock);
+}
+
+/* Copies the counts of a single load, which other loads may be updating too. */
+static void
+publishLoadStatistics(const struct MeshLoaderStatistics * load) {
+    pthread_mutex_lock(&memoryLock);
+    meshLoaderStatistics.projectedPeakMemory     = load->projectedPeakMemory;
+    meshLoaderStatistics.numberOfSnappedPositions = load->numberOfSnappedPositions;
+    meshLoaderStatistics.numberOfSnappedNormals   = load->numberOfSnappedNormals;
+    pthread_mutex_unlock(&memoryLock);
+}
+
+extern struct MeshLoaderStatistics
+getMeshLoaderStatistics(void) {
+    pthread_mutex_lock(&memoryLock);
+    struct MeshLoaderStatistics statistics = meshLoaderStatistics;
+    pthread_mutex_unlock(&memoryLock);
+    return statistics;
+}
+
+/* Returns nonzero if a load would not fit the budget, so it can be rejected before it 
+ * allocates anything. */
+static int
+checkMemoryBudget(const char * filepath, size_t projectedPeak) {
+    size_t budget = meshLoaderOptions.memoryBudget;
+    if (budget && budget < projectedPeak) {
+        printf("Loading %s needs about %zu bytes, over the budget of %zu, skipping it\n", 
+            filepath, projectedPeak, budget);
+        return 1;
+    }
     return 0;
 }
 
+/* Snapping moves positions and normals that differ by float noise onto one value, so
+ * faces that share a corner agree on it exactly: seams close, and exact deduplication,
+ * such as that of the cache codec, finds the copies. The output stays de-indexed, so
+ * snapping does not lower the number of vertices uploaded to the GPU.
+ *
+ * Every attribute is merged into the first earlier kept attribute within epsilon
+ * of it, if there is one, and kept otherwise. Comparing only with kept attributes
+ * means merges never chain, so no two attributes more than epsilon apart end up as
+ * one. Attributes are hashed into a grid of epsilon sized cells, so only the 27 cells
+ * around an attribute have to be searched. An attribute without any earlier one 
+ * within epsilon is kept whatever else is, and finding those runs in parallel, which
+ * leaves only the duplicates for the pass in order. */
+struct SnapGrid {
+    GLfloat (*attributes)[3];
+    GLfloat epsilon;
+    unsigned long mask;
+    unsigned long * bucketOfAttribute;
+    unsigned long * bucketStart;
+    unsigned long * attributesInBuckets;
+    unsigned long * remap;
+};
+
+/* Cells are clamped so that tiny epsilons and huge or NaN coordinates still convert to
+ * a long long. Clamping keeps attributes within epsilon in neighbouring cells. */
+#define MAX_CELL 1e15
+
+static long long
+cellOf(GLfloat x, GLfloat epsilon) {
+    double cell = floor((double)x / epsilon);
+    if (!(-MAX_CELL <= cell)) cell = -MAX_CELL;
+    if (MAX_CELL < cell) cell = MAX_CELL;
+    return (long long)cell;
+}
+
+static unsigned long
+bucketOfCell(long long x, long long y, long long z, unsigned long mask) {
+    return ((unsigned long)x * 73856093UL 
+          ^ (unsigned long)y * 19349663UL 
+          ^ (unsigned long)z * 83492791UL) & mask;
+}
+
+static void
+hashAttributes(void * context, unsigned long begin, unsigned long end) {
+    struct SnapGrid * grid = context;
+    for (unsigned long i = begin; i < end; ++i) {
+        GLfloat * a = grid->attributes[i];
+        grid->bucketOfAttribute[i] = bucketOfCell(cellOf(a[0], grid->epsilon), 
+            cellOf(a[1], grid->epsilon), cellOf(a[2], grid->epsilon), grid->mask);
+    }
+}
+
+/* Returns the first attribute before i within epsilon of it, or i if there is none.
+ * With keptOnly set, only attributes already kept count, which remap tells once the
+ * pass in order is past them. */
+static unsigned long
+findSnapTarget(struct SnapGrid * grid, unsigned long i, int keptOnly) {
+    GLfloat epsilonSquared = grid->epsilon * grid->epsilon;
+    GLfloat * a = grid->attributes[i];
+    long long x = cellOf(a[0], grid->epsilon);
+    long long y = cellOf(a[1], grid->epsilon);
+    long long z = cellOf(a[2], grid->epsilon);
+    unsigned long target = i;
+    for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dz = -1; dz <= 1; ++dz) {
+                unsigned long bucket = bucketOfCell(x + dx, y + dy, z + dz, grid->mask);
+                unsigned long last = grid->bucketStart[bucket + 1];
+                for (unsigned long k = grid->bucketStart[bucket]; k < last; ++k) {
+                    unsigned long j = grid->attributesInBuckets[k];
+                    if (target <= j) break;
+                    if (keptOnly && grid->remap[j] != j) continue;
+                    GLfloat * b = grid->attributes[j];
+                    GLfloat d[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+                    if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= epsilonSquared) {
+                        target = j;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return target;
+}
+
+static void
+findSnapTargets(void * context, unsigned long begin, unsigned long end) {
+    struct SnapGrid * grid = context;
+    for (unsigned long i = begin; i < end; ++i) grid->remap[i] = findSnapTarget(grid, i, 0);
+}
+
+/* Merges attributes closer than epsilon into the first of them, compacts the array 
+ * in place and fills remap with the new index of every old attribute. Returns the 
+ * new number of attributes. */
+static unsigned long
+snapAttributes(GLfloat (*attributes)[3], unsigned long count, GLfloat epsilon, 
+        unsigned long * remap) {
+    if (!count) return 0;
+    unsigned long numberOfBuckets = 1;
+    while (numberOfBuckets < 2 * count) numberOfBuckets *= 2;
+    size_t gridSize = (2 * count + numberOfBuckets + 1) * sizeof(unsigned long);
+    trackMemory(gridSize);
+    struct SnapGrid grid = {
+        .attributes = attributes,
+        .epsilon = epsilon,
+        .mask = numberOfBuckets - 1,
+        .bucketOfAttribute = emalloc(count * sizeof(unsigned long)),
+        .bucketStart = emalloc((numberOfBuckets + 1) * sizeof(unsigned long)),
+        .attributesInBuckets = emalloc(count * sizeof(unsigned long)),
+        .remap = remap,
+    };
+    parallelFor(count, hashAttributes, &grid);
+    memset(grid.bucketStart, 0, (numberOfBuckets + 1) * sizeof(unsigned long));
+    for (unsigned long i = 0; i < count; ++i) ++grid.bucketStart[grid.bucketOfAttribute[i] + 1];
+    for (unsigned long i = 0; i < numberOfBuckets; ++i) {
+        grid.bucketStart[i + 1] += grid.bucketStart[i];
+    }
+    for (unsigned long i = 0; i < count; ++i) {
+        grid.attributesInBuckets[grid.bucketStart[grid.bucketOfAttribute[i]]++] = i;
+    }
+    for (unsigned long i = numberOfBuckets; 0 < i; --i) {
+        grid.bucketStart[i] = grid.bucketStart[i - 1];
+    }
+    grid.bucketStart[0] = 0;
+    parallelFor(count, findSnapTargets, &grid);
+    for (unsigned long i = 0; i < count; ++i) {
+        if (remap[i] != i) remap[i] = findSnapTarget(&grid, i, 1);
+    }
+    unsigned long numberOfSnapped = 0;
+    for (unsigned long i = 0; i < count; ++i) {
+        if (remap[i] == i) {
+            memcpy(&attributes[numberOfSnapped], &attributes[i], sizeof(GLfloat[3]));
+            remap[i] = numberOfSnapped++;
+        } else {
+            remap[i] = remap[remap[i]]; /* a kept attribute, so already renumbered */
+        }
+    }
+    free(grid.bucketOfAttribute);
+    free(grid.bucketStart);
+    free(grid.attributesInBuckets);
+    releaseMemory(gridSize);
+    return numberOfSnapped;
+}
+
+static void
+remapFace(struct Face * face, unsigned long * positionRemap, unsigned long numberOfPositions,
+        unsigned long * normalRemap, unsigned long numberOfNormals) {
+    for (unsigned i = 0; i < face->numberOfVertices; ++i) {
+        struct VertexAttributeIndices * vertex = &face->vertices[i];
+        if (vertex->indexOfPosition < numberOfPositions) {
+            vertex->indexOfPosition = positionRemap[vertex->indexOfPosition];
+        }
+        if (vertex->indexOfNormal < numberOfNormals) {
+            vertex->indexOfNormal = normalRemap[vertex->indexOfNormal];
+        }
+    }
+}
+
 static GLuint
 createBuffer(void * data, size_t size) {
     GLuint id;
@@ -201,83 +621,1346 @@ createBuffer(void * data, size_t size) {
     return id;
 }
 
-extern struct Mesh 
-createMeshFromObj(char * filepath, GLuint texture) {
-    fileContent = loadFile(filepath);
+/* Vertex data is written straight into the mapped buffer, so there is no staging 
+ * copy in client memory. The mapped range is invalidated since it is written from 
+ * scratch, and no draw reads it before then. */
+static void *
+mapBuffer(GLuint buffer, size_t offset, size_t size) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (!size) return NULL;
+    void * data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, 
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!data) exit(1);
+    return data;
+}
+
+static void
+unmapBuffer(GLuint buffer, size_t size) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (!size) return;
+    if (!glUnmapBuffer(GL_ARRAY_BUFFER)) exit(1);
+}
+
+static void
+uploadToBuffer(GLuint buffer, size_t offset, void * data, size_t size) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+}
+
+/* Faces are parsed and de-indexed this many at a time, so only one batch of faces 
+ * lives in memory next to the attribute arrays. */
+#define FACES_PER_BATCH 4096
+
+struct VertexBatch {
+    GLfloat (*positions)[3];
+    GLfloat (*textureCoordinates)[3];
+    GLfloat (*normals)[3];
+    unsigned long numberOfVertices;
+    struct VertexBatch * next;
+};
+
+/* Loaders hand their output to a sink: they announce the total number of vertices 
+ * first, then ask the sink for room for every batch and commit the batch once it has 
+ * been written. Several batches may be reserved before they are committed in order. */
+struct VertexSink {
+    void (*allocate)(struct VertexSink * sink, unsigned long numberOfVertices);
+    void (*reserve)(struct VertexSink * sink, struct VertexBatch * batch);
+    void (*commit)(struct VertexSink * sink, struct VertexBatch * batch);
+};
+
+/* Faces are parsed a group of batches at a time and the group is then de-indexed in 
+ * parallel. Parsing takes the prefix sum of the triangle counts, so every face knows 
+ * where its vertices start within its batch. */
+#define BATCHES_PER_GATHER 16
+
+struct Gathering {
+    GLfloat (*positions)[3];
+    GLfloat (*textureCoordinates)[3];
+    GLfloat (*normals)[3];
+    struct Face * faces;
+    unsigned long * firstVertices;
+    struct VertexBatch * batches;
+};
+
+/* Copies the attributes of the corners of a triangle to out. The SSE version loads 
+ * four floats per corner, so attribute arrays have one spare element at the end. */
+static void
+gatherTriangle(GLfloat * out, GLfloat (*attributes)[3], 
+        unsigned long a, unsigned long b, unsigned long c) {
+#ifdef __SSE__
+    __m128 x = _mm_loadu_ps(attributes[a]);
+    __m128 y = _mm_loadu_ps(attributes[b]);
+    __m128 z = _mm_loadu_ps(attributes[c]);
+    __m128 xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 2, 2));
+    _mm_storeu_ps(out, _mm_shuffle_ps(x, xy, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 0, 2, 1)));
+    _mm_store_ss(out + 8, _mm_movehl_ps(z, z));
+#else
+    memcpy(out,     attributes[a], sizeof(GLfloat[3]));
+    memcpy(out + 3, attributes[b], sizeof(GLfloat[3]));
+    memcpy(out + 6, attributes[c], sizeof(GLfloat[3]));
+#endif
+}
+
+static void
+gatherFaces(void * context, unsigned long begin, unsigned long end) {
+    struct Gathering * gathering = context;
+    for (unsigned long i = begin; i < end; ++i) {
+        struct VertexBatch * batch = &gathering->batches[i / FACES_PER_BATCH];
+        struct VertexAttributeIndices * vertices = gathering->faces[i].vertices;
+        unsigned long k = gathering->firstVertices[i];
+        for (unsigned long j = 1; j < gathering->faces[i].numberOfVertices - 1; ++j, k += 3) {
+            gatherTriangle(batch->positions[k], gathering->positions, 
+                vertices[0].indexOfPosition, vertices[j].indexOfPosition, 
+                vertices[j + 1].indexOfPosition);
+            gatherTriangle(batch->textureCoordinates[k], gathering->textureCoordinates, 
+                vertices[0].indexOfTextureCoordinate, vertices[j].indexOfTextureCoordinate,
+                vertices[j + 1].indexOfTextureCoordinate);
+            gatherTriangle(batch->normals[k], gathering->normals, 
+                vertices[0].indexOfNormal, vertices[j].indexOfNormal, 
+                vertices[j + 1].indexOfNormal);
+        }
+        free(vertices);
+    }
+}
+
+/* Returns the memory the attribute, remap and face arrays of loadObj peak at, with one
+ * group of faces assuming an average number of corners per face, and with the group's
+ * vertices counted as if the sink kept them on the heap. */
+static size_t
+projectObjMemory(unsigned long numberOfPositions, unsigned long numberOfTextureCoordinates,
+        unsigned long numberOfNormals, unsigned long numberOfFaces, 
+        unsigned long numberOfTriangles, unsigned long facesPerGather, int snap) {
+    size_t attributesSize = (numberOfPositions + numberOfTextureCoordinates 
+        + numberOfNormals + 3) * sizeof(GLfloat[3]);
+    size_t remapSize = 0, gridSize = 0;
+    if (snap) {
+        unsigned long largest = numberOfPositions < numberOfNormals ? numberOfNormals 
+            : numberOfPositions;
+        unsigned long numberOfBuckets = 1;
+        while (numberOfBuckets < 2 * largest) numberOfBuckets *= 2;
+        remapSize = (numberOfPositions + numberOfNormals) * sizeof(unsigned long);
+        gridSize = (2 * largest + numberOfBuckets + 1) * sizeof(unsigned long);
+    }
+    double share = numberOfFaces <= facesPerGather ? 1 : (double)facesPerGather / numberOfFaces;
+    double groupCorners = share * (numberOfTriangles + 2.0 * numberOfFaces);
+    double groupVertices = share * numberOfTriangles * 3;
+    size_t groupSize = facesPerGather * (sizeof(struct Face) + sizeof(unsigned long))
+        + (size_t)(groupCorners * sizeof(struct VertexAttributeIndices))
+        + (size_t)(groupVertices * 3 * sizeof(GLfloat[3]));
+    return attributesSize + remapSize + (gridSize < groupSize ? groupSize : gridSize);
+}
+
+/* In low footprint mode, the pages of the file behind the parser are dropped as soon as
+ * they have been parsed, snapped attributes are shrunk and faces are de-indexed a 
+ * single batch at a time. Stores the counts of the load to load and returns nonzero without
+ * touching the sink if it is over the memory budget. */
+static int
+loadObj(char * filepath, struct VertexSink * sink, struct MeshLoaderStatistics * load) {
+    pthread_mutex_lock(&parserLock);
+    int lowFootprint = meshLoaderOptions.lowFootprint;
+    size_t mappingSize, discardedSize = 0;
+    fileContent = mapFile(filepath, &mappingSize);
+    trackMemory(mappingSize);
     reset();
     unsigned long numberOfPositions          = 0;
     unsigned long numberOfTextureCoordinates = 0;
     unsigned long numberOfNormals            = 0;
     unsigned long numberOfFaces              = 0;
-    while (!parsePosition(NULL))          ++numberOfPositions;
-    while (!parseTextureCoordinate(NULL)) ++numberOfTextureCoordinates;
-    while (!parseNormal(NULL))            ++numberOfNormals;
-    while (!parseFace(NULL))              ++numberOfFaces;
+    unsigned long numberOfTriangles          = 0;
+    while (!countLine("v "))               ++numberOfPositions;
+    while (!countLine("vt "))              ++numberOfTextureCoordinates;
+    while (!countLine("vn "))              ++numberOfNormals;
+    while (!countFace(&numberOfTriangles)) ++numberOfFaces;
     reset();
-    GLfloat (*positions)[3]          = emalloc(numberOfPositions          * sizeof(GLfloat[3]));
-    GLfloat (*textureCoordinates)[3] = emalloc(numberOfTextureCoordinates * sizeof(GLfloat[3]));
-    GLfloat (*normals)[3]            = emalloc(numberOfNormals            * sizeof(GLfloat[3]));
-    struct Face * faces              = emalloc(numberOfFaces              * sizeof(struct Face));
-    for (int i = 0; !parsePosition((GLfloat *)&positions[i]);                   ++i);
-    for (int i = 0; !parseTextureCoordinate((GLfloat *)&textureCoordinates[i]); ++i);
-    for (int i = 0; !parseNormal((GLfloat *)&normals[i]);                       ++i);
-    unsigned long numberOfTriangles = 0;
-    for (int i = 0; !parseFace(&faces[i]); ++i) {
-        numberOfTriangles += faces[i].numberOfVertices - 2;
-    }
-    unsigned long numberOfVertices = numberOfTriangles * 3;
-    size_t bufferSize = numberOfVertices * sizeof(GLfloat[3]);
-    GLfloat (*p)[3], (*t)[3], (*n)[3];
-    GLfloat (*positionsBufferData)[3]          = p = emalloc(bufferSize);
-    GLfloat (*textureCoordinatesBufferData)[3] = t = emalloc(bufferSize);
-    GLfloat (*normalsBufferData)[3]            = n = emalloc(bufferSize);
-    for (unsigned long i = 0; i < numberOfFaces; ++i) {
-        struct VertexAttributeIndices * vertices = faces[i].vertices;
-        for (unsigned long j = 1; j < faces[i].numberOfVertices - 1; ++j) {
-            memcpy(p++, &positions[vertices[0].indexOfPosition], sizeof(GLfloat[3]));
-            memcpy(p++, &positions[vertices[j].indexOfPosition], sizeof(GLfloat[3]));
-            memcpy(p++, &positions[vertices[j + 1].indexOfPosition], sizeof(GLfloat[3]));
-            memcpy(t++, &textureCoordinates[vertices[0].indexOfTextureCoordinate], sizeof(GLfloat[3]));
-            memcpy(t++, &textureCoordinates[vertices[j].indexOfTextureCoordinate], sizeof(GLfloat[3]));
-            memcpy(t++, &textureCoordinates[vertices[j + 1].indexOfTextureCoordinate], sizeof(GLfloat[3]));
-            memcpy(n++, &normals[vertices[0].indexOfNormal], sizeof(GLfloat[3]));
-            memcpy(n++, &normals[vertices[j].indexOfNormal], sizeof(GLfloat[3]));
-            memcpy(n++, &normals[vertices[j + 1].indexOfNormal], sizeof(GLfloat[3]));
+    unsigned long facesPerGather = (lowFootprint ? 1 : BATCHES_PER_GATHER) * FACES_PER_BATCH;
+    memset(load, 0, sizeof(*load));
+    load->projectedPeakMemory = mappingSize + projectObjMemory(numberOfPositions,
+        numberOfTextureCoordinates, numberOfNormals, numberOfFaces, numberOfTriangles, 
+        facesPerGather, 0 < meshLoaderOptions.snapEpsilon);
+    if (checkMemoryBudget(filepath, load->projectedPeakMemory)) {
+        publishLoadStatistics(load);
+        unmapFile(fileContent, mappingSize);
+        releaseMemory(mappingSize);
+        pthread_mutex_unlock(&parserLock);
+        return 1;
+    }
+    size_t positionsSize          = (numberOfPositions + 1)          * sizeof(GLfloat[3]);
+    size_t textureCoordinatesSize = (numberOfTextureCoordinates + 1) * sizeof(GLfloat[3]);
+    size_t normalsSize            = (numberOfNormals + 1)            * sizeof(GLfloat[3]);
+    trackMemory(positionsSize + textureCoordinatesSize + normalsSize);
+    GLfloat (*positions)[3]          = emalloc(positionsSize);
+    GLfloat (*textureCoordinates)[3] = emalloc(textureCoordinatesSize);
+    GLfloat (*normals)[3]            = emalloc(normalsSize);
+    for (unsigned long i = 0; !parsePosition((GLfloat *)&positions[i]);                   ++i);
+    for (unsigned long i = 0; !parseTextureCoordinate((GLfloat *)&textureCoordinates[i]); ++i);
+    for (unsigned long i = 0; !parseNormal((GLfloat *)&normals[i]);                       ++i);
+    if (lowFootprint) {
+        discardedSize = discardMappedPages(fileContent, currentPosition.offset);
+        releaseMemory(discardedSize);
+    }
+    unsigned long * positionRemap = NULL;
+    unsigned long * normalRemap = NULL;
+    size_t remapSize = 0;
+    if (0 < meshLoaderOptions.snapEpsilon) {
+        GLfloat epsilon = meshLoaderOptions.snapEpsilon;
+        remapSize = (numberOfPositions + numberOfNormals) * sizeof(unsigned long);
+        trackMemory(remapSize);
+        positionRemap = emalloc(numberOfPositions * sizeof(unsigned long));
+        normalRemap   = emalloc(numberOfNormals   * sizeof(unsigned long));
+        load->numberOfSnappedPositions = numberOfPositions
+            - snapAttributes(positions, numberOfPositions, epsilon, positionRemap);
+        load->numberOfSnappedNormals = numberOfNormals
+            - snapAttributes(normals, numberOfNormals, epsilon, normalRemap);
+        if (lowFootprint) {
+            size_t snappedPositionsSize = positionsSize 
+                - load->numberOfSnappedPositions * sizeof(GLfloat[3]);
+            size_t snappedNormalsSize = normalsSize 
+                - load->numberOfSnappedNormals * sizeof(GLfloat[3]);
+            positions = erealloc(positions, snappedPositionsSize);
+            normals = erealloc(normals, snappedNormalsSize);
+            releaseMemory(positionsSize - snappedPositionsSize 
+                + normalsSize - snappedNormalsSize);
+            positionsSize = snappedPositionsSize;
+            normalsSize = snappedNormalsSize;
         }
     }
-    struct Mesh mesh;
-    glGenVertexArrays(1, &mesh.vao);
-    glBindVertexArray(mesh.vao);
-    mesh.texture                  = texture;
-    mesh.numberOfVertices         = numberOfVertices;
-    mesh.positionsBuffer          = createBuffer(positionsBufferData, bufferSize);
-    mesh.textureCoordinatesBuffer = createBuffer(textureCoordinatesBufferData, bufferSize);
-    mesh.normalsBuffer            = createBuffer(normalsBufferData, bufferSize);
-    struct Material material = {
-        .ambient = { 0.2, 0.2, 0.2 },
-        .diffuse = { 0.6, 0.6, 0.6 },
-        .specular = { 0.8, 0.8, 0.8 },
-        .shininess = 100,
+    publishLoadStatistics(load);
+    sink->allocate(sink, numberOfTriangles * 3);
+    size_t facesSize = facesPerGather * (sizeof(struct Face) + sizeof(unsigned long));
+    trackMemory(facesSize);
+    struct Face * faces = emalloc(facesPerGather * sizeof(struct Face));
+    unsigned long * firstVertices = emalloc(facesPerGather * sizeof(unsigned long));
+    struct VertexBatch batches[BATCHES_PER_GATHER];
+    struct Gathering gathering = { 
+        positions, textureCoordinates, normals, faces, firstVertices, batches 
     };
-    mesh.material = material;
+    for (unsigned long first = 0; first < numberOfFaces; first += facesPerGather) {
+        unsigned long numberOfGatherFaces = numberOfFaces - first;
+        if (facesPerGather < numberOfGatherFaces) numberOfGatherFaces = facesPerGather;
+        unsigned numberOfBatches = 0;
+        size_t cornersSize = 0;
+        for (unsigned long i = 0; i < numberOfGatherFaces; ++i) {
+            if (!(i % FACES_PER_BATCH)) {
+                batches[numberOfBatches++] = (struct VertexBatch){ .numberOfVertices = 0 };
+            }
+            struct VertexBatch * batch = &batches[numberOfBatches - 1];
+            if (parseFace(&faces[i])) error();
+            if (positionRemap) {
+                remapFace(&faces[i], positionRemap, numberOfPositions, 
+                    normalRemap, numberOfNormals);
+            }
+            firstVertices[i] = batch->numberOfVertices;
+            batch->numberOfVertices += (faces[i].numberOfVertices - 2) * 3;
+            cornersSize += faces[i].numberOfVertices * sizeof(struct VertexAttributeIndices);
+        }
+        trackMemory(cornersSize);
+        if (lowFootprint) {
+            size_t size = discardMappedPages(fileContent, currentPosition.offset);
+            if (discardedSize < size) {
+                releaseMemory(size - discardedSize);
+                discardedSize = size;
+            }
+        }
+        for (unsigned i = 0; i < numberOfBatches; ++i) sink->reserve(sink, &batches[i]);
+        parallelFor(numberOfGatherFaces, gatherFaces, &gathering);
+        releaseMemory(cornersSize);
+        struct ParserState parser;
+        suspendParser(&parser);
+        for (unsigned i = 0; i < numberOfBatches; ++i) sink->commit(sink, &batches[i]);
+        resumeParser(&parser);
+    }
+    free(positions);
+    free(textureCoordinates);
+    free(normals);
+    free(positionRemap);
+    free(normalRemap);
+    free(faces);
+    free(firstVertices);
+    releaseMemory(positionsSize + textureCoordinatesSize + normalsSize + remapSize + facesSize);
+    unmapFile(fileContent, mappingSize);
+    releaseMemory(mappingSize - discardedSize);
+    pthread_mutex_unlock(&parserLock);
+    return 0;
+}
+
+static struct Mesh
+createMesh(GLuint texture) {
+    struct Mesh mesh;
+    mesh.parts            = NULL;
+    mesh.numberOfParts    = 0;
+    mesh.texture          = texture;
+    mesh.material         = defaultMaterial;
+    mesh.numberOfVertices = 0;
+    mesh.indexBuffer      = 0;
+    mesh.stream           = NULL;
+    return mesh;
+}
+
+static struct MeshPart *
+appendMeshPart(struct Mesh * mesh) {
+    mesh->parts = erealloc(mesh->parts, (mesh->numberOfParts + 1) * sizeof(struct MeshPart));
+    struct MeshPart * part = &mesh->parts[mesh->numberOfParts++];
+    part->firstVertex = 0;
+    part->numberOfVertices = 0;
+    part->capacity = 0;
+    return part;
+}
+
+static struct MeshPart *
+addMeshPart(struct Mesh * mesh) {
+    struct MeshPart * part = appendMeshPart(mesh);
+    glGenVertexArrays(1, &part->vao);
+    bindVertexArray(part->vao);
+    return part;
+}
+
+static void
+pointVertexAttributes(GLuint positions, GLuint textureCoordinates, GLuint normals) {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionsBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, positions);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 0, NULL);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.textureCoordinatesBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, textureCoordinates);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_TRUE, 0, NULL);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.normalsBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, normals);
     glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, 0, NULL);
-    free(positions);
-    free(textureCoordinates);
-    free(normals);
-    for (unsigned long i = 0; i < numberOfFaces; ++i) {
-        free(faces[i].vertices);
+}
+
+/* The first draw index is a GLint, so that bounds the capacity. */
+extern void
+createGeometryArena(struct GeometryArena * arena, unsigned long capacity) {
+    if (INT_MAX < capacity) exit(1);
+    glGenVertexArrays(1, &arena->vao);
+    bindVertexArray(arena->vao);
+    size_t bufferSize = capacity * sizeof(GLfloat[3]);
+    arena->positionsBuffer          = createBuffer(NULL, bufferSize);
+    arena->textureCoordinatesBuffer = createBuffer(NULL, bufferSize);
+    arena->normalsBuffer            = createBuffer(NULL, bufferSize);
+    pointVertexAttributes(arena->positionsBuffer, arena->textureCoordinatesBuffer, 
+        arena->normalsBuffer);
+    arena->numberOfVertices = 0;
+    arena->capacity = capacity;
+}
+
+/* A mesh goes into the arena whole, as its only part, or not at all. Returns NULL if
+ * there is no arena or not enough room left in it. */
+static struct MeshPart *
+addArenaPart(struct Mesh * mesh, unsigned long numberOfVertices) {
+    struct GeometryArena * arena = meshLoaderOptions.arena;
+    if (!arena || arena->capacity - arena->numberOfVertices < numberOfVertices) return NULL;
+    struct MeshPart * part = appendMeshPart(mesh);
+    part->vao                      = arena->vao;
+    part->positionsBuffer          = arena->positionsBuffer;
+    part->textureCoordinatesBuffer = arena->textureCoordinatesBuffer;
+    part->normalsBuffer            = arena->normalsBuffer;
+    part->firstVertex = arena->numberOfVertices;
+    part->capacity = numberOfVertices;
+    arena->numberOfVertices += numberOfVertices;
+    return part;
+}
+
+/* Draw calls count vertices with a GLsizei, so that bounds a part even without a 
+ * buffer size limit. Parts hold whole triangles. */
+static unsigned long
+maxVerticesPerPart(void) {
+    unsigned long limit = INT_MAX - INT_MAX % 3;
+    size_t bufferSize = meshLoaderOptions.maxBufferSize;
+    if (bufferSize && bufferSize / sizeof(GLfloat[3]) < limit) {
+        limit = bufferSize / sizeof(GLfloat[3]) / 3 * 3;
     }
-    free(faces);
-    free(positionsBufferData);
-    free(textureCoordinatesBufferData);
-    free(normalsBufferData);
+    return limit;
+}
+
+/* Returns the part the next numberOfVertices vertices of a mesh go to. Batches are 
+ * never split, so a part that has no room left for a batch is closed and a new one 
+ * is sized for the rest of the mesh, up to the limit but at least one batch. The first
+ * part holds the whole mesh instead if it fits into the geometry arena. */
+static struct MeshPart *
+partForVertices(struct Mesh * mesh, unsigned long numberOfVertices, 
+        unsigned long numberOfRemainingVertices) {
+    if (mesh->numberOfParts) {
+        struct MeshPart * part = &mesh->parts[mesh->numberOfParts - 1];
+        if (numberOfVertices <= part->capacity - part->numberOfVertices) return part;
+    } else {
+        unsigned long numberOfMeshVertices = numberOfRemainingVertices < numberOfVertices 
+            ? numberOfVertices : numberOfRemainingVertices;
+        struct MeshPart * part = addArenaPart(mesh, numberOfMeshVertices);
+        if (part) return part;
+    }
+    struct MeshPart * part = addMeshPart(mesh);
+    part->capacity = maxVerticesPerPart();
+    if (numberOfRemainingVertices < part->capacity) part->capacity = numberOfRemainingVertices;
+    if (part->capacity < numberOfVertices) part->capacity = numberOfVertices;
+    size_t bufferSize = part->capacity * sizeof(GLfloat[3]);
+    part->positionsBuffer          = createBuffer(NULL, bufferSize);
+    part->textureCoordinatesBuffer = createBuffer(NULL, bufferSize);
+    part->normalsBuffer            = createBuffer(NULL, bufferSize);
+    pointVertexAttributes(part->positionsBuffer, part->textureCoordinatesBuffer, 
+        part->normalsBuffer);
+    return part;
+}
+
+/* Writes batches straight into the buffers of the mesh parts, every part mapped from 
+ * when it is added until the whole load is done. */
+struct MappedVertexSink {
+    struct VertexSink sink;
+    struct Mesh * mesh;
+    unsigned long numberOfVertices;
+    struct VertexBatch * mappings; /* one per part */
+};
+
+static void
+allocateMappedVertices(struct VertexSink * sink, unsigned long numberOfVertices) {
+    struct MappedVertexSink * mapped = (struct MappedVertexSink *)sink;
+    mapped->numberOfVertices = numberOfVertices;
+}
+
+static void
+reserveMappedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    struct MappedVertexSink * mapped = (struct MappedVertexSink *)sink;
+    struct Mesh * mesh = mapped->mesh;
+    unsigned long numberOfParts = mesh->numberOfParts;
+    struct MeshPart * part = partForVertices(mesh, batch->numberOfVertices, 
+        mapped->numberOfVertices - mesh->numberOfVertices);
+    if (numberOfParts != mesh->numberOfParts) {
+        size_t offset = part->firstVertex * sizeof(GLfloat[3]);
+        size_t size = part->capacity * sizeof(GLfloat[3]);
+        mapped->mappings = erealloc(mapped->mappings, 
+            mesh->numberOfParts * sizeof(struct VertexBatch));
+        struct VertexBatch * mapping = &mapped->mappings[numberOfParts];
+        mapping->positions          = mapBuffer(part->positionsBuffer, offset, size);
+        mapping->textureCoordinates = mapBuffer(part->textureCoordinatesBuffer, offset, size);
+        mapping->normals            = mapBuffer(part->normalsBuffer, offset, size);
+    }
+    struct VertexBatch * mapping = &mapped->mappings[mesh->numberOfParts - 1];
+    batch->positions          = mapping->positions + part->numberOfVertices;
+    batch->textureCoordinates = mapping->textureCoordinates + part->numberOfVertices;
+    batch->normals            = mapping->normals + part->numberOfVertices;
+    part->numberOfVertices += batch->numberOfVertices;
+    mesh->numberOfVertices += batch->numberOfVertices;
+}
+
+static void
+commitMappedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    (void)sink, (void)batch;
+}
+
+/* With meshLoaderOptions.useCache set, the de-indexed vertices of an OBJ are kept 
+ * next to it in <file>.cache, compressed chunk by chunk with meshcodec. The cache is
+ * used while the size and modification time of the OBJ and the snap epsilon match 
+ * the ones it was written with. Its chunks are decoded in parallel. */
+#define OBJ_CACHE_MAGIC   0x4843424F
+#define OBJ_CACHE_VERSION 3
+
+#define CHUNKS_PER_DECODE 16
+
+struct ObjCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    struct FileStamp source;
+    float snapEpsilon;
+    uint32_t numberOfChunks;
+    uint64_t numberOfVertices;
+    uint64_t numberOfSnappedPositions;
+    uint64_t numberOfSnappedNormals;
+    uint64_t chunkTableOffset;
+};
+
+struct ObjCacheChunk {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t numberOfVertices;
+};
+
+struct CacheDecoding {
+    const unsigned char * data;
+    struct ObjCacheChunk * chunks;
+    struct VertexBatch * batches;
+    int * failed;
+};
+
+static void
+decodeCacheChunks(void * context, unsigned long begin, unsigned long end) {
+    struct CacheDecoding * decoding = context;
+    for (unsigned long i = begin; i < end; ++i) {
+        struct ObjCacheChunk * chunk = &decoding->chunks[i];
+        struct VertexBatch * batch = &decoding->batches[i];
+        decoding->failed[i] = decodeMeshChunk(decoding->data + chunk->offset, chunk->size, 
+            batch->positions, batch->textureCoordinates, batch->normals, 
+            batch->numberOfVertices);
+    }
+}
+
+/* Returns nonzero without touching the sink if there is no up to date cache, and 
+ * negative if there is one but loading it is over the memory budget. */
+static int
+loadObjCache(char * filepath, struct VertexSink * sink) {
+    struct FileStamp source;
+    struct FileStamp cache;
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    if (stampFile(filepath, &source, 0) || stampFile(cachePath, &cache, 0) 
+            || cache.size < sizeof(struct ObjCacheHeader)) {
+        free(cachePath);
+        return 1;
+    }
+    size_t mappingSize, discardedSize = 0;
+    char * mapping = mapFile(cachePath, &mappingSize);
+    free(cachePath);
+    struct ObjCacheHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    uint64_t cacheSize = cache.size;
+    uint64_t tableSize = (uint64_t)header.numberOfChunks * sizeof(struct ObjCacheChunk);
+    int valid = OBJ_CACHE_MAGIC == header.magic && OBJ_CACHE_VERSION == header.version
+        && source.size == header.source.size 
+        && source.modificationTime == header.source.modificationTime
+        && meshLoaderOptions.snapEpsilon == header.snapEpsilon
+        && !(header.chunkTableOffset % sizeof(uint64_t))
+        && header.chunkTableOffset <= cacheSize 
+        && tableSize <= cacheSize - header.chunkTableOffset;
+    struct ObjCacheChunk * chunks = (struct ObjCacheChunk *)(mapping + header.chunkTableOffset);
+    uint64_t numberOfVertices = 0, largestChunk = 0;
+    for (uint32_t i = 0; valid && i < header.numberOfChunks; ++i) {
+        valid = chunks[i].offset <= cacheSize && chunks[i].size <= cacheSize - chunks[i].offset;
+        numberOfVertices += chunks[i].numberOfVertices;
+        if (largestChunk < chunks[i].numberOfVertices) largestChunk = chunks[i].numberOfVertices;
+    }
+    if (!valid || numberOfVertices != header.numberOfVertices) {
+        unmapFile(mapping, mappingSize);
+        return 1;
+    }
+    struct MeshLoaderStatistics load = {
+        .numberOfSnappedPositions = header.numberOfSnappedPositions,
+        .numberOfSnappedNormals   = header.numberOfSnappedNormals,
+        .projectedPeakMemory     = mappingSize 
+            + CHUNKS_PER_DECODE * largestChunk * 3 * sizeof(GLfloat[3]),
+    };
+    publishLoadStatistics(&load);
+    if (checkMemoryBudget(filepath, load.projectedPeakMemory)) {
+        unmapFile(mapping, mappingSize);
+        return -1;
+    }
+    trackMemory(mappingSize);
+    sink->allocate(sink, header.numberOfVertices);
+    struct VertexBatch batches[CHUNKS_PER_DECODE];
+    int failed[CHUNKS_PER_DECODE];
+    struct CacheDecoding decoding = {
+        .data = (unsigned char *)mapping,
+        .batches = batches,
+        .failed = failed,
+    };
+    for (uint32_t first = 0; first < header.numberOfChunks; first += CHUNKS_PER_DECODE) {
+        uint32_t count = header.numberOfChunks - first;
+        if (CHUNKS_PER_DECODE < count) count = CHUNKS_PER_DECODE;
+        for (uint32_t i = 0; i < count; ++i) {
+            batches[i].numberOfVertices = chunks[first + i].numberOfVertices;
+            sink->reserve(sink, &batches[i]);
+        }
+        decoding.chunks = &chunks[first];
+        parallelFor(count, decodeCacheChunks, &decoding);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (failed[i]) exit(1);
+            sink->commit(sink, &batches[i]);
+        }
+        if (meshLoaderOptions.lowFootprint) {
+            struct ObjCacheChunk * last = &chunks[first + count - 1];
+            size_t size = discardMappedPages(mapping, last->offset + last->size);
+            if (discardedSize < size) {
+                releaseMemory(size - discardedSize);
+                discardedSize = size;
+            }
+        }
+    }
+    unmapFile(mapping, mappingSize);
+    releaseMemory(mappingSize - discardedSize);
+    return 0;
+}
+
+/* Encodes every batch into the cache file before committing it to the real sink. */
+struct CacheWriterSink {
+    struct VertexSink sink;
+    struct VertexSink * inner;
+    FILE * file;
+    int failed;
+    uint64_t offset;
+    uint64_t numberOfVertices;
+    struct ObjCacheChunk * chunks;
+    uint32_t numberOfChunks;
+    uint32_t chunkCapacity;
+};
+
+static void
+allocateCachedVertices(struct VertexSink * sink, unsigned long numberOfVertices) {
+    struct CacheWriterSink * writer = (struct CacheWriterSink *)sink;
+    writer->numberOfVertices = numberOfVertices;
+    if (writer->inner) writer->inner->allocate(writer->inner, numberOfVertices);
+}
+
+/* Batches are reserved in the real sink, so they are encoded where they will stay,
+ * and only a cache without a sink needs memory of its own. */
+static void
+reserveCachedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    struct CacheWriterSink * writer = (struct CacheWriterSink *)sink;
+    if (writer->inner) {
+        writer->inner->reserve(writer->inner, batch);
+        return;
+    }
+    size_t size = batch->numberOfVertices * sizeof(GLfloat[3]);
+    trackMemory(3 * size);
+    batch->positions          = emalloc(size);
+    batch->textureCoordinates = emalloc(size);
+    batch->normals            = emalloc(size);
+}
+
+static void
+commitCachedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    struct CacheWriterSink * writer = (struct CacheWriterSink *)sink;
+    size_t encodedSize = maxEncodedMeshChunkSize(batch->numberOfVertices);
+    trackMemory(encodedSize);
+    unsigned char * encoded = emalloc(encodedSize);
+    size_t size = encodeMeshChunk(encoded, batch->positions, batch->textureCoordinates, 
+        batch->normals, batch->numberOfVertices);
+    if (size != fwrite(encoded, 1, size, writer->file)) writer->failed = 1;
+    free(encoded);
+    releaseMemory(encodedSize);
+    if (writer->numberOfChunks == writer->chunkCapacity) {
+        writer->chunkCapacity = writer->chunkCapacity ? 2 * writer->chunkCapacity : 64;
+        writer->chunks = erealloc(writer->chunks, 
+            writer->chunkCapacity * sizeof(struct ObjCacheChunk));
+    }
+    struct ObjCacheChunk chunk = { writer->offset, size, batch->numberOfVertices };
+    writer->chunks[writer->numberOfChunks++] = chunk;
+    writer->offset += size;
+    if (writer->inner) {
+        writer->inner->commit(writer->inner, batch);
+        return;
+    }
+    free(batch->positions);
+    free(batch->textureCoordinates);
+    free(batch->normals);
+    releaseMemory(3 * batch->numberOfVertices * sizeof(GLfloat[3]));
+}
+
+/* Parses the OBJ while writing its cache to a temporary file, which replaces the old
+ * cache only once it is complete. The sink may be NULL when only the cache is wanted.
+ * Returns nonzero if the cache could not be written, and negative if the load was over
+ * the memory budget, which leaves the sink untouched. */
+static int
+loadObjWritingCache(char * filepath, struct FileStamp * source, struct VertexSink * sink) {
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    char * temporaryPath = pathWithSuffix(filepath, ".cache.tmp");
+    struct CacheWriterSink writer = {
+        .sink = { allocateCachedVertices, reserveCachedVertices, commitCachedVertices },
+        .inner = sink,
+        .file = fopen(temporaryPath, "wb"),
+        .offset = sizeof(struct ObjCacheHeader),
+    };
+    struct MeshLoaderStatistics load;
+    int rejected = 0;
+    if (!writer.file) {
+        rejected = sink && loadObj(filepath, sink, &load);
+        writer.failed = 1;
+    } else {
+        struct ObjCacheHeader header = { .magic = 0 };
+        writer.failed |= 1 != fwrite(&header, sizeof(header), 1, writer.file);
+        rejected = loadObj(filepath, &writer.sink, &load);
+        writer.failed |= rejected;
+        uint64_t padding = 0;
+        size_t paddingSize = (sizeof(uint64_t) - writer.offset % sizeof(uint64_t)) % sizeof(uint64_t);
+        writer.failed |= paddingSize != fwrite(&padding, 1, paddingSize, writer.file);
+        header.magic                    = OBJ_CACHE_MAGIC;
+        header.version                  = OBJ_CACHE_VERSION;
+        header.source                   = *source;
+        header.snapEpsilon              = meshLoaderOptions.snapEpsilon;
+        header.numberOfChunks           = writer.numberOfChunks;
+        header.numberOfVertices         = writer.numberOfVertices;
+        header.numberOfSnappedPositions = load.numberOfSnappedPositions;
+        header.numberOfSnappedNormals   = load.numberOfSnappedNormals;
+        header.chunkTableOffset         = writer.offset + paddingSize;
+        if (writer.numberOfChunks) {
+            writer.failed |= writer.numberOfChunks != fwrite(writer.chunks, 
+                sizeof(struct ObjCacheChunk), writer.numberOfChunks, writer.file);
+        }
+        writer.failed |= fseek(writer.file, 0, SEEK_SET);
+        writer.failed |= 1 != fwrite(&header, sizeof(header), 1, writer.file);
+        writer.failed |= fclose(writer.file);
+        if (writer.failed || rename(temporaryPath, cachePath)) {
+            remove(temporaryPath);
+            writer.failed = 1;
+        }
+    }
+    free(writer.chunks);
+    free(cachePath);
+    free(temporaryPath);
+    return rejected ? -1 : writer.failed;
+}
+
+/* Returns nonzero if the load was over the memory budget, which leaves the sink 
+ * untouched. */
+static int
+loadObjOrCache(char * filepath, struct VertexSink * sink) {
+    struct FileStamp source;
+    struct MeshLoaderStatistics load;
+    int cached = meshLoaderOptions.useCache ? loadObjCache(filepath, sink) : 1;
+    if (cached <= 0) return cached;
+    if (!meshLoaderOptions.useCache || stampFile(filepath, &source, 1)) {
+        return loadObj(filepath, sink, &load);
+    }
+    return loadObjWritingCache(filepath, &source, sink) < 0;
+}
+
+/* Builds the cache of an OBJ ahead of time. A cache whose content hash still matches
+ * is only restamped with the current size and modification time of the OBJ, so a 
+ * fresh checkout does not force a rebuild. Returns nonzero if the cache was already
+ * up to date. */
+extern int
+cookMesh(char * filepath) {
+    struct FileStamp source;
+    if (stampFile(filepath, &source, 1)) exit(1);
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    FILE * cache = fopen(cachePath, "r+b");
+    free(cachePath);
+    struct ObjCacheHeader header;
+    int upToDate = cache && 1 == fread(&header, sizeof(header), 1, cache)
+        && OBJ_CACHE_MAGIC == header.magic && OBJ_CACHE_VERSION == header.version
+        && source.hash == header.source.hash 
+        && meshLoaderOptions.snapEpsilon == header.snapEpsilon;
+    if (upToDate) {
+        header.source                   = source;
+        if (fseek(cache, 0, SEEK_SET) || 1 != fwrite(&header, sizeof(header), 1, cache)) exit(1);
+    }
+    if (cache && fclose(cache)) exit(1);
+    if (!upToDate && loadObjWritingCache(filepath, &source, NULL)) exit(1);
+    return upToDate;
+}
+
+extern struct Mesh 
+createMeshFromObj(char * filepath, GLuint texture) {
+    struct Mesh mesh = createMesh(texture);
+    struct MappedVertexSink sink = {
+        .sink = { allocateMappedVertices, reserveMappedVertices, commitMappedVertices },
+        .mesh = &mesh,
+    };
+    loadObjOrCache(filepath, &sink.sink);
+    for (unsigned long i = 0; i < mesh.numberOfParts; ++i) {
+        size_t bufferSize = mesh.parts[i].capacity * sizeof(GLfloat[3]);
+        unmapBuffer(mesh.parts[i].positionsBuffer, bufferSize);
+        unmapBuffer(mesh.parts[i].textureCoordinatesBuffer, bufferSize);
+        unmapBuffer(mesh.parts[i].normalsBuffer, bufferSize);
+    }
+    free(sink.mappings);
+    return mesh;
+}
+
+/* A streamed mesh is parsed, or decoded from its cache, on a background thread, which
+ * queues finished batches for uploadStreamedBatches to append on the GL thread. This is
+ * background batch streaming, not a progressive mesh: batches come in file order at
+ * full detail, with no coarse base mesh and no refinement records, so a mesh shows up
+ * piece by piece rather than coarse first. The queue is bounded, so the loader waits
+ * instead of piling up the whole de-indexed mesh when frames are slow. */
+#define MAX_QUEUED_BATCHES 16
+
+struct MeshStream {
+    struct VertexSink sink;
+    char * filepath;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t consumed;
+    unsigned long numberOfVertices;
+    int finished;
+    struct VertexBatch * firstBatch;
+    struct VertexBatch * lastBatch;
+    unsigned numberOfQueuedBatches;
+};
+
+static void
+announceStreamedVertices(struct VertexSink * sink, unsigned long numberOfVertices) {
+    struct MeshStream * stream = (struct MeshStream *)sink;
+    pthread_mutex_lock(&stream->lock);
+    stream->numberOfVertices = numberOfVertices;
+    pthread_mutex_unlock(&stream->lock);
+}
+
+static void
+reserveStreamedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    (void)sink;
+    size_t size = batch->numberOfVertices * sizeof(GLfloat[3]);
+    trackMemory(3 * size);
+    batch->positions          = emalloc(size);
+    batch->textureCoordinates = emalloc(size);
+    batch->normals            = emalloc(size);
+}
+
+static void
+queueStreamedVertices(struct VertexSink * sink, struct VertexBatch * batch) {
+    struct MeshStream * stream = (struct MeshStream *)sink;
+    struct VertexBatch * queued = emalloc(sizeof(struct VertexBatch));
+    *queued = *batch;
+    queued->next = NULL;
+    pthread_mutex_lock(&stream->lock);
+    while (MAX_QUEUED_BATCHES <= stream->numberOfQueuedBatches) {
+        pthread_cond_wait(&stream->consumed, &stream->lock);
+    }
+    if (stream->lastBatch) stream->lastBatch->next = queued;
+    else stream->firstBatch = queued;
+    stream->lastBatch = queued;
+    ++stream->numberOfQueuedBatches;
+    pthread_mutex_unlock(&stream->lock);
+}
+
+static void *
+runMeshStream(void * argument) {
+    struct MeshStream * stream = argument;
+    loadObjOrCache(stream->filepath, &stream->sink);
+    pthread_mutex_lock(&stream->lock);
+    stream->finished = 1;
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+extern struct Mesh
+streamMeshFromObj(char * filepath, GLuint texture) {
+    struct Mesh mesh = createMesh(texture);
+    struct MeshStream * stream = emalloc(sizeof(struct MeshStream));
+    memset(stream, 0, sizeof(struct MeshStream));
+    stream->sink.allocate = announceStreamedVertices;
+    stream->sink.reserve  = reserveStreamedVertices;
+    stream->sink.commit   = queueStreamedVertices;
+    stream->filepath = emalloc(strlen(filepath) + 1);
+    strcpy(stream->filepath, filepath);
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->consumed, NULL);
+    if (pthread_create(&stream->thread, NULL, runMeshStream, stream)) exit(1);
+    mesh.stream = stream;
+    return mesh;
+}
+
+extern void
+uploadStreamedBatches(struct Mesh * mesh) {
+    struct MeshStream * stream = mesh->stream;
+    if (!stream) return;
+    pthread_mutex_lock(&stream->lock);
+    struct VertexBatch * batch = stream->firstBatch;
+    int finished = stream->finished;
+    stream->firstBatch = stream->lastBatch = NULL;
+    stream->numberOfQueuedBatches = 0;
+    pthread_cond_signal(&stream->consumed);
+    pthread_mutex_unlock(&stream->lock);
+    while (batch) {
+        struct MeshPart * part = partForVertices(mesh, batch->numberOfVertices, 
+            stream->numberOfVertices - mesh->numberOfVertices);
+        size_t offset = (part->firstVertex + part->numberOfVertices) * sizeof(GLfloat[3]);
+        size_t size = batch->numberOfVertices * sizeof(GLfloat[3]);
+        uploadToBuffer(part->positionsBuffer, offset, batch->positions, size);
+        uploadToBuffer(part->textureCoordinatesBuffer, offset, batch->textureCoordinates, size);
+        uploadToBuffer(part->normalsBuffer, offset, batch->normals, size);
+        part->numberOfVertices += batch->numberOfVertices;
+        mesh->numberOfVertices += batch->numberOfVertices;
+        struct VertexBatch * next = batch->next;
+        free(batch->positions);
+        free(batch->textureCoordinates);
+        free(batch->normals);
+        free(batch);
+        releaseMemory(3 * size);
+        batch = next;
+    }
+    if (finished) {
+        pthread_join(stream->thread, NULL);
+        pthread_mutex_destroy(&stream->lock);
+        pthread_cond_destroy(&stream->consumed);
+        free(stream->filepath);
+        free(stream);
+        mesh->stream = NULL;
+    }
+}
+
+/* A .glb file is a 12 byte header followed by a JSON chunk describing the scene and a
+ * binary chunk holding the vertex and index data. Only the first primitive of the 
+ * first mesh is loaded. Accessor component types are OpenGL enums and every accessor
+ * layout glTF allows for these attributes can be consumed by glVertexAttribPointer as
+ * is, so buffer views are uploaded straight from the mapped file. Texture coordinates
+ * go up as glTF stores them, with v running down the image. solid.frag flips v for 
+ * OBJ, so a .glb mesh shows its texture upside down; nothing here corrects that. */
+
+#define GLB_MAGIC      0x46546C67
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN  0x004E4942
+
+#define GLB_ABSENT ((unsigned long)-1)
+
+/* Objects and arrays nest at most this deep, so a hostile file cannot exhaust the stack */
+#define MAX_JSON_DEPTH 64
+
+static int jsonDepth; /* guarded by parserLock like the rest of the parser */
+
+struct GlbAccessor {
+    unsigned long bufferView;
+    unsigned long byteOffset;
+    unsigned long count;
+    unsigned long componentType;
+    unsigned long numberOfComponents;
+    unsigned long normalized;
+};
+
+struct GlbBufferView {
+    unsigned long buffer;
+    unsigned long byteOffset;
+    unsigned long byteLength;
+    unsigned long byteStride;
+};
+
+struct GlbPrimitive {
+    unsigned long position;
+    unsigned long textureCoordinate;
+    unsigned long normal;
+    unsigned long indices;
+    unsigned long mode;
+};
+
+struct GlbDocument {
+    struct GlbAccessor * accessors;
+    unsigned long numberOfAccessors;
+    struct GlbBufferView * bufferViews;
+    unsigned long numberOfBufferViews;
+    struct GlbPrimitive primitive;
+};
+
+static void
+skipJsonSpaces(void) {
+    while (isspace(peekChar())) consumeChar();
+}
+
+static int
+acceptJson(const char * token) {
+    skipJsonSpaces();
+    return accept(token);
+}
+
+static void
+expectJson(const char * token) {
+    if (acceptJson(token)) error();
+}
+
+static void
+parseJsonString(char * out, size_t size) {
+    expectJson("\"");
+    size_t length = 0;
+    while ('"' != peekChar()) {
+        if ('\\' == peekChar()) consumeChar();
+        if (length + 1 < size) out[length++] = peekChar();
+        consumeChar();
+    }
+    consumeChar();
+    out[length] = 0;
+}
+
+static void
+parseJsonUnsignedLong(unsigned long * out) {
+    skipJsonSpaces();
+    if (parseUnsignedLong(out)) error();
+}
+
+static void
+parseJsonObject(void (*parseMember)(const char * key, void * context), void * context) {
+    expectJson("{");
+    if (MAX_JSON_DEPTH < ++jsonDepth) error();
+    if (acceptJson("}")) {
+        do {
+            char key[64];
+            parseJsonString(key, sizeof(key));
+            expectJson(":");
+            parseMember(key, context);
+        } while (!acceptJson(","));
+        expectJson("}");
+    }
+    --jsonDepth;
+}
+
+static unsigned long
+parseJsonArray(void (*parseElement)(unsigned long index, void * context), void * context) {
+    unsigned long count = 0;
+    expectJson("[");
+    if (MAX_JSON_DEPTH < ++jsonDepth) error();
+    if (acceptJson("]")) {
+        do parseElement(count++, context); while (!acceptJson(","));
+        expectJson("]");
+    }
+    --jsonDepth;
+    return count;
+}
+
+static void skipJsonValue(void);
+
+static void
+skipJsonMember(const char * key, void * context) {
+    (void)key, (void)context;
+    skipJsonValue();
+}
+
+static void
+skipJsonElement(unsigned long index, void * context) {
+    (void)index, (void)context;
+    skipJsonValue();
+}
+
+static void
+skipJsonValue(void) {
+    skipJsonSpaces();
+    if ('{' == peekChar()) {
+        parseJsonObject(skipJsonMember, NULL);
+    } else if ('[' == peekChar()) {
+        parseJsonArray(skipJsonElement, NULL);
+    } else if ('"' == peekChar()) {
+        char ignored[1];
+        parseJsonString(ignored, sizeof(ignored));
+    } else {
+        if (!isalnum(peekChar()) && '-' != peekChar()) error();
+        while (isalnum(peekChar()) || (peekChar() && strchr("+-.", peekChar()))) consumeChar();
+    }
+}
+
+struct JsonObjectArray {
+    void (*parseMember)(const char * key, void * element);
+    char * elements;
+    size_t elementSize;
+};
+
+static void
+parseJsonObjectArrayElement(unsigned long index, void * context) {
+    struct JsonObjectArray * array = context;
+    parseJsonObject(array->parseMember, array->elements + index * array->elementSize);
+}
+
+/* Parses an array of objects into zero initialized elements, counting them first 
+ * just like the OBJ parser counts attributes before reading them. */
+static void *
+parseJsonObjectArray(void (*parseMember)(const char * key, void * element), 
+        size_t elementSize, unsigned long * count) {
+    rememberPosition();
+    *count = parseJsonArray(skipJsonElement, NULL);
+    restorePosition();
+    struct JsonObjectArray array = {
+        .parseMember = parseMember,
+        .elements = emalloc(*count * elementSize),
+        .elementSize = elementSize,
+    };
+    memset(array.elements, 0, *count * elementSize);
+    parseJsonArray(parseJsonObjectArrayElement, &array);
+    return array.elements;
+}
+
+static void
+parseGlbAccessorMember(const char * key, void * element) {
+    struct GlbAccessor * accessor = element;
+    if (!strcmp(key, "bufferView")) {
+        parseJsonUnsignedLong(&accessor->bufferView);
+    } else if (!strcmp(key, "byteOffset")) {
+        parseJsonUnsignedLong(&accessor->byteOffset);
+    } else if (!strcmp(key, "count")) {
+        parseJsonUnsignedLong(&accessor->count);
+    } else if (!strcmp(key, "componentType")) {
+        parseJsonUnsignedLong(&accessor->componentType);
+    } else if (!strcmp(key, "normalized")) {
+        accessor->normalized = !acceptJson("true");
+        if (!accessor->normalized) expectJson("false");
+    } else if (!strcmp(key, "type")) {
+        char type[8];
+        parseJsonString(type, sizeof(type));
+        if (!strcmp(type, "SCALAR"))    accessor->numberOfComponents = 1;
+        else if (!strcmp(type, "VEC2")) accessor->numberOfComponents = 2;
+        else if (!strcmp(type, "VEC3")) accessor->numberOfComponents = 3;
+        else if (!strcmp(type, "VEC4")) accessor->numberOfComponents = 4;
+    } else if (!strcmp(key, "sparse")) {
+        error();
+    } else {
+        skipJsonValue();
+    }
+}
+
+static void
+parseGlbBufferViewMember(const char * key, void * element) {
+    struct GlbBufferView * bufferView = element;
+    if (!strcmp(key, "buffer")) {
+        parseJsonUnsignedLong(&bufferView->buffer);
+    } else if (!strcmp(key, "byteOffset")) {
+        parseJsonUnsignedLong(&bufferView->byteOffset);
+    } else if (!strcmp(key, "byteLength")) {
+        parseJsonUnsignedLong(&bufferView->byteLength);
+    } else if (!strcmp(key, "byteStride")) {
+        parseJsonUnsignedLong(&bufferView->byteStride);
+    } else {
+        skipJsonValue();
+    }
+}
+
+static void
+parseGlbAttribute(const char * key, void * context) {
+    struct GlbPrimitive * primitive = context;
+    if (!strcmp(key, "POSITION")) {
+        parseJsonUnsignedLong(&primitive->position);
+    } else if (!strcmp(key, "TEXCOORD_0")) {
+        parseJsonUnsignedLong(&primitive->textureCoordinate);
+    } else if (!strcmp(key, "NORMAL")) {
+        parseJsonUnsignedLong(&primitive->normal);
+    } else {
+        skipJsonValue();
+    }
+}
+
+static void
+parseGlbPrimitiveMember(const char * key, void * context) {
+    struct GlbPrimitive * primitive = context;
+    if (!strcmp(key, "attributes")) {
+        parseJsonObject(parseGlbAttribute, primitive);
+    } else if (!strcmp(key, "indices")) {
+        parseJsonUnsignedLong(&primitive->indices);
+    } else if (!strcmp(key, "mode")) {
+        parseJsonUnsignedLong(&primitive->mode);
+    } else {
+        skipJsonValue();
+    }
+}
+
+static void
+parseGlbPrimitive(unsigned long index, void * context) {
+    if (index) skipJsonValue();
+    else parseJsonObject(parseGlbPrimitiveMember, context);
+}
+
+static void
+parseGlbMeshMember(const char * key, void * context) {
+    if (!strcmp(key, "primitives")) parseJsonArray(parseGlbPrimitive, context);
+    else skipJsonValue();
+}
+
+static void
+parseGlbMesh(unsigned long index, void * context) {
+    if (index) skipJsonValue();
+    else parseJsonObject(parseGlbMeshMember, context);
+}
+
+static void
+parseGlbRootMember(const char * key, void * context) {
+    struct GlbDocument * document = context;
+    if (!strcmp(key, "accessors")) {
+        document->accessors = parseJsonObjectArray(parseGlbAccessorMember, 
+            sizeof(struct GlbAccessor), &document->numberOfAccessors);
+    } else if (!strcmp(key, "bufferViews")) {
+        document->bufferViews = parseJsonObjectArray(parseGlbBufferViewMember, 
+            sizeof(struct GlbBufferView), &document->numberOfBufferViews);
+    } else if (!strcmp(key, "meshes")) {
+        parseJsonArray(parseGlbMesh, &document->primitive);
+    } else {
+        skipJsonValue();
+    }
+}
+
+static uint32_t
+readUint32(const char * data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static unsigned long
+sizeOfComponentType(unsigned long componentType) {
+    switch (componentType) {
+    case GL_BYTE: case GL_UNSIGNED_BYTE:   return 1;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT: case GL_FLOAT:   return 4;
+    default: exit(1);
+    }
+}
+
+struct GlbBinary {
+    struct GlbDocument * document;
+    const char * data;
+    size_t size;
+    GLuint * buffers;
+};
+
+/* Returns the accessor after checking that all of its elements lie inside its buffer
+ * view and that the view lies inside the binary chunk, so GL never reads past them. */
+static struct GlbAccessor *
+getGlbAccessor(struct GlbBinary * binary, unsigned long index) {
+    struct GlbDocument * document = binary->document;
+    if (document->numberOfAccessors <= index) exit(1);
+    struct GlbAccessor * accessor = &document->accessors[index];
+    if (document->numberOfBufferViews <= accessor->bufferView) exit(1);
+    struct GlbBufferView * view = &document->bufferViews[accessor->bufferView];
+    if (view->buffer || binary->size < view->byteOffset 
+            || binary->size - view->byteOffset < view->byteLength) exit(1);
+    if (!accessor->numberOfComponents || !accessor->count) exit(1);
+    unsigned long elementSize = 
+        accessor->numberOfComponents * sizeOfComponentType(accessor->componentType);
+    unsigned long stride = view->byteStride ? view->byteStride : elementSize;
+    if (view->byteLength < elementSize 
+            || view->byteLength - elementSize < accessor->byteOffset
+            || (view->byteLength - elementSize - accessor->byteOffset) / stride 
+                < accessor->count - 1) exit(1);
+    return accessor;
+}
+
+/* Every buffer view becomes at most one GL buffer, uploaded directly from the 
+ * mapping, however many accessors refer to it. */
+static GLuint
+getGlbBuffer(struct GlbBinary * binary, unsigned long bufferView) {
+    struct GlbBufferView * view = &binary->document->bufferViews[bufferView];
+    if (!binary->buffers[bufferView]) {
+        binary->buffers[bufferView] = 
+            createBuffer((void *)(binary->data + view->byteOffset), view->byteLength);
+    }
+    return binary->buffers[bufferView];
+}
+
+static GLuint
+bindGlbAttribute(struct GlbBinary * binary, GLuint location, unsigned long index) {
+    if (GLB_ABSENT == index) return 0;
+    struct GlbAccessor * accessor = getGlbAccessor(binary, index);
+    GLuint buffer = getGlbBuffer(binary, accessor->bufferView);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, accessor->numberOfComponents, accessor->componentType, 
+        accessor->normalized, binary->document->bufferViews[accessor->bufferView].byteStride,
+        (void *)accessor->byteOffset);
+    return buffer;
+}
+
+struct GlbFile {
+    char * mapping;
+    size_t mappingSize;
+    struct GlbDocument document;
+    struct GlbBinary binary;
+};
+
+/* Returns the largest value of an index accessor, which getGlbAccessor has checked
+ * and openGlb has made sure is tightly packed, as GL reads it. */
+static unsigned long
+maxGlbIndex(struct GlbBinary * binary, struct GlbAccessor * indices) {
+    struct GlbBufferView * view = &binary->document->bufferViews[indices->bufferView];
+    const unsigned char * data = 
+        (const unsigned char *)binary->data + view->byteOffset + indices->byteOffset;
+    unsigned long size = sizeOfComponentType(indices->componentType), largest = 0;
+    for (unsigned long i = 0; i < indices->count; ++i, data += size) {
+        unsigned long index;
+        if (1 == size) {
+            index = *data;
+        } else if (2 == size) {
+            uint16_t value;
+            memcpy(&value, data, size);
+            index = value;
+        } else {
+            uint32_t value;
+            memcpy(&value, data, size);
+            index = value;
+        }
+        if (largest < index) largest = index;
+    }
+    return largest;
+}
+
+/* Maps and parses a .glb file and checks the primitive and every accessor it uses, so
+ * whatever passes can be handed to GL as it is: every accessor lies inside the binary
+ * chunk, the other attributes have an element for every position, every index names
+ * a position, and all counts fit a GLsizei. */
+static void
+openGlb(char * filepath, struct GlbFile * glb) {
+    char * file = glb->mapping = mapFile(filepath, &glb->mappingSize);
+    trackMemory(glb->mappingSize);
+    if (glb->mappingSize < 20 || GLB_MAGIC != readUint32(file) || 2 != readUint32(file + 4)) {
+        exit(1);
+    }
+    size_t fileSize = readUint32(file + 8);
+    size_t jsonSize = readUint32(file + 12);
+    if (glb->mappingSize <= fileSize || fileSize < 20 || fileSize - 20 < jsonSize 
+            || GLB_CHUNK_JSON != readUint32(file + 16)) exit(1);
+    pthread_mutex_lock(&parserLock);
+    fileContent = emalloc(jsonSize + 1);
+    memcpy(fileContent, file + 20, jsonSize);
+    fileContent[jsonSize] = 0;
+    jsonDepth = 0;
+    reset();
+    struct GlbDocument * document = &glb->document;
+    memset(document, 0, sizeof(*document));
+    document->primitive = (struct GlbPrimitive){ 
+        GLB_ABSENT, GLB_ABSENT, GLB_ABSENT, GLB_ABSENT, GL_TRIANGLES 
+    };
+    parseJsonObject(parseGlbRootMember, document);
+    free(fileContent);
+    pthread_mutex_unlock(&parserLock);
+    size_t binOffset = 20 + jsonSize;
+    if (fileSize - binOffset < 8 || GLB_CHUNK_BIN != readUint32(file + binOffset + 4)) exit(1);
+    glb->binary = (struct GlbBinary){
+        .document = document,
+        .data = file + binOffset + 8,
+        .size = readUint32(file + binOffset),
+        .buffers = emalloc((document->numberOfBufferViews + 1) * sizeof(GLuint)),
+    };
+    if (fileSize - binOffset - 8 < glb->binary.size) exit(1);
+    memset(glb->binary.buffers, 0, (document->numberOfBufferViews + 1) * sizeof(GLuint));
+    struct GlbPrimitive * primitive = &document->primitive;
+    if (GLB_ABSENT == primitive->position || GL_TRIANGLES != primitive->mode) exit(1);
+    unsigned long attributes[] = { 
+        primitive->position, primitive->textureCoordinate, primitive->normal 
+    };
+    unsigned long numberOfPositions = 
+        getGlbAccessor(&glb->binary, primitive->position)->count;
+    if (INT_MAX < numberOfPositions) exit(1);
+    for (int i = 0; i < 3; ++i) {
+        if (GLB_ABSENT == attributes[i]) continue;
+        if (getGlbAccessor(&glb->binary, attributes[i])->count < numberOfPositions) exit(1);
+    }
+    if (GLB_ABSENT != primitive->indices) {
+        struct GlbAccessor * indices = getGlbAccessor(&glb->binary, primitive->indices);
+        struct GlbBufferView * view = &document->bufferViews[indices->bufferView];
+        if (1 != indices->numberOfComponents || (GL_UNSIGNED_BYTE != indices->componentType 
+                && GL_UNSIGNED_SHORT != indices->componentType 
+                && GL_UNSIGNED_INT != indices->componentType)) exit(1);
+        unsigned long size = sizeOfComponentType(indices->componentType);
+        if ((view->byteStride && size != view->byteStride) || indices->byteOffset % size
+                || INT_MAX < indices->count 
+                || numberOfPositions <= maxGlbIndex(&glb->binary, indices)) exit(1);
+    }
+}
+
+static void
+closeGlb(struct GlbFile * glb) {
+    free(glb->document.accessors);
+    free(glb->document.bufferViews);
+    free(glb->binary.buffers);
+    unmapFile(glb->mapping, glb->mappingSize);
+    releaseMemory(glb->mappingSize);
+}
+
+extern void
+checkGlb(char * filepath) {
+    struct GlbFile glb;
+    openGlb(filepath, &glb);
+    closeGlb(&glb);
+}
+
+extern struct Mesh
+createMeshFromGlb(char * filepath, GLuint texture) {
+    struct GlbFile glb;
+    openGlb(filepath, &glb);
+    struct GlbBinary * binary = &glb.binary;
+    struct GlbPrimitive * primitive = &glb.document.primitive;
+    struct Mesh mesh = createMesh(texture);
+    struct MeshPart * part = addMeshPart(&mesh);
+    mesh.numberOfVertices = getGlbAccessor(binary, primitive->position)->count;
+    part->numberOfVertices = part->capacity = mesh.numberOfVertices;
+    part->positionsBuffer = bindGlbAttribute(binary, 0, primitive->position);
+    part->textureCoordinatesBuffer = bindGlbAttribute(binary, 1, primitive->textureCoordinate);
+    part->normalsBuffer   = bindGlbAttribute(binary, 2, primitive->normal);
+    if (GLB_ABSENT != primitive->indices) {
+        struct GlbAccessor * indices = getGlbAccessor(binary, primitive->indices);
+        mesh.indexBuffer     = getGlbBuffer(binary, indices->bufferView);
+        mesh.indexType       = indices->componentType;
+        mesh.indexOffset     = indices->byteOffset;
+        mesh.numberOfIndices = indices->count;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    }
+    closeGlb(&glb);
     return mesh;
 }
@@ -5,16 +5,77 @@ struct Material {
     GLfloat shininess;
 };
 
-struct Mesh {
+struct MeshStream;
+
+/* A range of the vertices of a mesh with buffers of its own, so no buffer has to grow
+ * past meshLoaderOptions.maxBufferSize and every range fits a single draw call. */
+struct MeshPart {
     GLuint vao;
     GLuint positionsBuffer;
     GLuint textureCoordinatesBuffer;
     GLuint normalsBuffer;
+    unsigned long firstVertex; /* in the buffers, which a geometry arena shares */
+    unsigned long numberOfVertices;
+    unsigned long capacity; /* in vertices */
+};
+
+/* Vertex buffers and a VAO shared by the meshes loaded into them, each a range of 
+ * vertices, so consecutive draws of different meshes bind nothing in between. */
+struct GeometryArena {
+    GLuint vao;
+    GLuint positionsBuffer;
+    GLuint textureCoordinatesBuffer;
+    GLuint normalsBuffer;
+    unsigned long numberOfVertices;
+    unsigned long capacity;
+};
+
+struct Mesh {
+    struct MeshPart * parts;
+    unsigned long numberOfParts;
+    GLuint indexBuffer; /* 0 for meshes drawn without indices, else there is one part */
+    GLenum indexType;
+    size_t indexOffset;
     GLuint texture;
     struct Material material;
-    unsigned numberOfVertices;
+    unsigned long numberOfVertices;
+    unsigned numberOfIndices;
+    struct MeshStream * stream; /* NULL once the mesh is fully loaded */
+};
+
+struct MeshLoaderOptions {
+    GLfloat snapEpsilon;  /* snaps attributes this close together, 0 disables it */
+    int useCache;         /* keep compressed vertices in <file>.cache */
+    int lowFootprint;     /* free intermediates early at the cost of some speed */
+    size_t memoryBudget;  /* bytes a load may project to use, 0 for no limit */
+    size_t maxBufferSize; /* bytes per vertex buffer, 0 for as many as a draw can reach */
+    struct GeometryArena * arena; /* for OBJ meshes that fit, NULL for buffers of their own */
 };
 
+/* Memory counts cover the heap and file mappings of the loaders, not GL buffers. Loads
+ * update them from their own threads, so they are read through a snapshot. */
+struct MeshLoaderStatistics {
+    unsigned long numberOfSnappedPositions;
+    unsigned long numberOfSnappedNormals;
+    size_t currentMemory;
+    size_t peakMemory;
+    size_t projectedPeakMemory; /* of the last OBJ load */
+};
+
+extern struct MeshLoaderOptions meshLoaderOptions;
+extern struct MeshLoaderStatistics getMeshLoaderStatistics(void);
+
+extern void createGeometryArena(struct GeometryArena * arena, unsigned long capacity);
+
+/* An OBJ whose load is over meshLoaderOptions.memoryBudget is skipped, so its mesh is
+ * created, or finishes streaming, empty. */
 extern struct Mesh createMeshFromObj(char * filepath, GLuint texture);
+extern struct Mesh createMeshFromGlb(char * filepath, GLuint texture);
+extern void checkGlb(char * filepath);
+/* Loads an OBJ on a background thread. The mesh starts empty and grows by the batches
+ * that uploadStreamedBatches appends on the GL thread, once per frame. */
+extern struct Mesh streamMeshFromObj(char * filepath, GLuint texture);
+extern void uploadStreamedBatches(struct Mesh * mesh);
+extern int cookMesh(char * filepath);
 
-extern void drawMesh(struct Mesh mesh);
+extern void drawMesh(struct Mesh mesh, GLsizei numberOfInstances);
@@ -0,0 +1,270 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "meshcodec.h"
+
+/* A chunk is stored as its unique vertices followed by its triangles.
+ *
+ * Vertices are numbered in order of first use. Every one of their nine channels is 
+ * stored separately as varint coded zigzag deltas of the float bits against the 
+ * previous vertex, which is small for neighbouring vertices of smooth surfaces.
+ *
+ * Triangles are coded against a FIFO of recently seen edges, as in meshoptimizer's 
+ * index codec. A triangle sharing an edge with a recent one only costs the edge slot,
+ * the rotation that brings the edge first and its third vertex. Vertices are coded as
+ * "the next new vertex", a slot in a FIFO of recent vertices, or an explicit distance 
+ * back from the newest vertex.
+ *
+ * Attributes are not quantized, so the cache stays exact, and the index coding stops
+ * at the edge FIFO, with no edgebreaker style traversal. Decoding on one core runs at
+ * 0.9 to 2 GB/s of output for the meshes here (18 to 41 ns a vertex), short of 
+ * several GB/s; chunks decode in parallel to make up for it. */
+
+#define CHANNELS 9
+#define FIFO_SIZE 16
+
+#define TRIANGLE_WITHOUT_EDGE 0x00
+#define TRIANGLE_WITH_EDGE    0x80
+
+#define VERTEX_NEW      0
+#define VERTEX_FIFO     1
+#define VERTEX_EXPLICIT (VERTEX_FIFO + FIFO_SIZE)
+
+struct IndexCoder {
+    uint32_t edges[FIFO_SIZE][2];
+    uint32_t vertices[FIFO_SIZE];
+    unsigned edgeHead;
+    unsigned vertexHead;
+    uint32_t next;
+};
+
+static void
+resetIndexCoder(struct IndexCoder * coder) {
+    memset(coder, 0xff, sizeof(*coder));
+    coder->edgeHead = 0;
+    coder->vertexHead = 0;
+    coder->next = 0;
+}
+
+static void
+pushEdge(struct IndexCoder * coder, uint32_t a, uint32_t b) {
+    coder->edges[coder->edgeHead % FIFO_SIZE][0] = a;
+    coder->edges[coder->edgeHead % FIFO_SIZE][1] = b;
+    ++coder->edgeHead;
+}
+
+static void
+pushVertex(struct IndexCoder * coder, uint32_t v) {
+    coder->vertices[coder->vertexHead % FIFO_SIZE] = v;
+    ++coder->vertexHead;
+}
+
+/* Edges are pushed reversed, so a neighbour with consistent winding finds them as is. */
+static void
+pushTriangle(struct IndexCoder * coder, uint32_t a, uint32_t b, uint32_t c) {
+    pushEdge(coder, b, a);
+    pushEdge(coder, c, b);
+    pushEdge(coder, a, c);
+}
+
+static unsigned char *
+writeVarint(unsigned char * out, uint32_t value) {
+    while (0x80 <= value) {
+        *out++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static const unsigned char *
+readVarint(const unsigned char * in, const unsigned char * end, uint32_t * value) {
+    *value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7) {
+        unsigned char byte = *in++;
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return in;
+    }
+    return NULL;
+}
+
+static uint32_t
+zigzag(uint32_t delta) {
+    return (delta << 1) ^ (0 - (delta >> 31));
+}
+
+static uint32_t
+unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static unsigned char *
+encodeVertex(struct IndexCoder * coder, unsigned char * out, uint32_t v) {
+    if (v == coder->next) {
+        *out++ = VERTEX_NEW;
+        ++coder->next;
+        pushVertex(coder, v);
+        return out;
+    }
+    for (unsigned i = 0; i < FIFO_SIZE; ++i) {
+        if (coder->vertices[(coder->vertexHead - 1 - i) % FIFO_SIZE] == v) {
+            *out++ = VERTEX_FIFO + i;
+            return out;
+        }
+    }
+    *out++ = VERTEX_EXPLICIT;
+    pushVertex(coder, v);
+    return writeVarint(out, coder->next - 1 - v);
+}
+
+static const unsigned char *
+decodeVertex(struct IndexCoder * coder, const unsigned char * in, const unsigned char * end, 
+        uint32_t * v) {
+    if (end <= in) return NULL;
+    unsigned code = *in++;
+    if (VERTEX_NEW == code) {
+        *v = coder->next++;
+        pushVertex(coder, *v);
+    } else if (code < VERTEX_EXPLICIT) {
+        *v = coder->vertices[(coder->vertexHead - code) % FIFO_SIZE];
+    } else if (VERTEX_EXPLICIT == code) {
+        uint32_t distance;
+        if (!(in = readVarint(in, end, &distance)) || coder->next <= distance) return NULL;
+        *v = coder->next - 1 - distance;
+        pushVertex(coder, *v);
+    } else {
+        return NULL;
+    }
+    return in;
+}
+
+extern size_t
+maxEncodedMeshChunkSize(unsigned long numberOfVertices) {
+    /* one header varint for the number of unique vertices, five bytes per channel 
+     * varint and at most one code byte plus three vertex codes of up to six bytes per 
+     * triangle */
+    return 5 + numberOfVertices * CHANNELS * 5 + numberOfVertices / 3 * 19;
+}
+
+static uint32_t
+hashVertex(const uint32_t * vertex) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < CHANNELS; ++i) hash = (hash ^ vertex[i]) * 16777619u;
+    return hash;
+}
+
+extern size_t
+encodeMeshChunk(unsigned char * out, float (*positions)[3], 
+        float (*textureCoordinates)[3], float (*normals)[3], unsigned long numberOfVertices) {
+    uint32_t (*unique)[CHANNELS] = emalloc((numberOfVertices + 1) * sizeof(uint32_t[CHANNELS]));
+    uint32_t * indices = emalloc((numberOfVertices + 1) * sizeof(uint32_t));
+    unsigned long numberOfBuckets = 1;
+    while (numberOfBuckets < 2 * numberOfVertices) numberOfBuckets *= 2;
+    uint32_t * buckets = emalloc(numberOfBuckets * sizeof(uint32_t));
+    memset(buckets, 0xff, numberOfBuckets * sizeof(uint32_t));
+    uint32_t numberOfUnique = 0;
+    for (unsigned long i = 0; i < numberOfVertices; ++i) {
+        uint32_t * vertex = unique[numberOfUnique];
+        memcpy(&vertex[0], positions[i], sizeof(float[3]));
+        memcpy(&vertex[3], textureCoordinates[i], sizeof(float[3]));
+        memcpy(&vertex[6], normals[i], sizeof(float[3]));
+        unsigned long bucket = hashVertex(vertex) & (numberOfBuckets - 1);
+        while (UINT32_MAX != buckets[bucket] 
+                && memcmp(unique[buckets[bucket]], vertex, sizeof(uint32_t[CHANNELS]))) {
+            bucket = (bucket + 1) & (numberOfBuckets - 1);
+        }
+        if (UINT32_MAX == buckets[bucket]) buckets[bucket] = numberOfUnique++;
+        indices[i] = buckets[bucket];
+    }
+    free(buckets);
+    unsigned char * p = writeVarint(out, numberOfUnique);
+    for (int c = 0; c < CHANNELS; ++c) {
+        uint32_t previous = 0;
+        for (uint32_t v = 0; v < numberOfUnique; ++v) {
+            p = writeVarint(p, zigzag(unique[v][c] - previous));
+            previous = unique[v][c];
+        }
+    }
+    struct IndexCoder coder;
+    resetIndexCoder(&coder);
+    for (unsigned long i = 0; i + 2 < numberOfVertices; i += 3) {
+        uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        int found = 0;
+        for (unsigned r = 0; r < 3 && !found; ++r) {
+            uint32_t x = corners[r], y = corners[(r + 1) % 3];
+            for (unsigned s = 0; s < FIFO_SIZE; ++s) {
+                uint32_t * edge = coder.edges[(coder.edgeHead - 1 - s) % FIFO_SIZE];
+                if (edge[0] == x && edge[1] == y) {
+                    *p++ = TRIANGLE_WITH_EDGE | r << 4 | s;
+                    p = encodeVertex(&coder, p, corners[(r + 2) % 3]);
+                    found = 1;
+                    break;
+                }
+            }
+        }
+        if (!found) {
+            *p++ = TRIANGLE_WITHOUT_EDGE;
+            for (int k = 0; k < 3; ++k) p = encodeVertex(&coder, p, corners[k]);
+        }
+        pushTriangle(&coder, corners[0], corners[1], corners[2]);
+    }
+    free(unique);
+    free(indices);
+    return p - out;
+}
+
+extern int
+decodeMeshChunk(const unsigned char * in, size_t size, float (*positions)[3], 
+        float (*textureCoordinates)[3], float (*normals)[3], unsigned long numberOfVertices) {
+    const unsigned char * end = in + size;
+    uint32_t numberOfUnique;
+    if (!(in = readVarint(in, end, &numberOfUnique)) || numberOfVertices < numberOfUnique) {
+        return 1;
+    }
+    uint32_t (*unique)[CHANNELS] = emalloc((numberOfUnique + 1) * sizeof(uint32_t[CHANNELS]));
+    for (int c = 0; c < CHANNELS && in; ++c) {
+        uint32_t previous = 0;
+        for (uint32_t v = 0; v < numberOfUnique && in; ++v) {
+            uint32_t delta;
+            in = readVarint(in, end, &delta);
+            previous += unzigzag(delta);
+            unique[v][c] = previous;
+        }
+    }
+    struct IndexCoder coder;
+    resetIndexCoder(&coder);
+    for (unsigned long i = 0; in && i + 2 < numberOfVertices; i += 3) {
+        uint32_t corners[3];
+        if (end <= in) {
+            in = NULL;
+            break;
+        }
+        unsigned code = *in++;
+        if (TRIANGLE_WITHOUT_EDGE == code) {
+            for (int k = 0; k < 3 && in; ++k) in = decodeVertex(&coder, in, end, &corners[k]);
+        } else if (code & TRIANGLE_WITH_EDGE && ((code >> 4) & 7) < 3) {
+            unsigned r = (code >> 4) & 7, s = code & (FIFO_SIZE - 1);
+            uint32_t * edge = coder.edges[(coder.edgeHead - 1 - s) % FIFO_SIZE];
+            corners[r] = edge[0];
+            corners[(r + 1) % 3] = edge[1];
+            in = decodeVertex(&coder, in, end, &corners[(r + 2) % 3]);
+        } else {
+            in = NULL;
+        }
+        if (!in) break;
+        for (int k = 0; k < 3; ++k) {
+            if (numberOfUnique <= corners[k]) {
+                in = NULL;
+                break;
+            }
+            memcpy(positions[i + k], &unique[corners[k]][0], sizeof(float[3]));
+            memcpy(textureCoordinates[i + k], &unique[corners[k]][3], sizeof(float[3]));
+            memcpy(normals[i + k], &unique[corners[k]][6], sizeof(float[3]));
+        }
+        pushTriangle(&coder, corners[0], corners[1], corners[2]);
+    }
+    free(unique);
+    return !in || in != end;
+}
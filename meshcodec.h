@@ -0,0 +1,10 @@
+/* Lossless codec for chunks of a de-indexed triangle list with three vec3 attribute 
+ * streams. Decoding reproduces the input bit for bit. */
+
+extern size_t maxEncodedMeshChunkSize(unsigned long numberOfVertices);
+
+extern size_t encodeMeshChunk(unsigned char * out, float (*positions)[3], 
+    float (*textureCoordinates)[3], float (*normals)[3], unsigned long numberOfVertices);
+
+extern int decodeMeshChunk(const unsigned char * in, size_t size, float (*positions)[3], 
+    float (*textureCoordinates)[3], float (*normals)[3], unsigned long numberOfVertices);
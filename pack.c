@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "assetpack.h"
+
+/* pack [-z] output file...
+ *
+ * Writes the files into an asset pack the demo maps them from, see assetpack.c. 
+ * With -z, entries that compress well are stored compressed. */
+
+int main(int argc, char * argv[]) {
+    int compress = 1 < argc && !strcmp(argv[1], "-z");
+    if (argc < 2 + compress) {
+        printf("usage: %s [-z] output file...\n", argv[0]);
+        return 1;
+    }
+    return writeAssetPack(argv[1 + compress], argv + 2 + compress, argc - 2 - compress, 
+        compress);
+}
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "renderqueue.h"
+#include "utils.h"
+
+#define FIELD(value, bits) ((unsigned long long)(value) & ((1ull << (bits)) - 1))
+
+extern unsigned long long
+renderKey(unsigned pass, unsigned program, unsigned texture, unsigned material,
+        unsigned mesh, GLfloat depth) {
+    if (!(0 < depth)) depth = 0;
+    if (1 < depth) depth = 1;
+    unsigned long long key = FIELD(pass, RENDER_KEY_PASS_BITS);
+    key = key << RENDER_KEY_PROGRAM_BITS | FIELD(program, RENDER_KEY_PROGRAM_BITS);
+    key = key << RENDER_KEY_TEXTURE_BITS | FIELD(texture, RENDER_KEY_TEXTURE_BITS);
+    key = key << RENDER_KEY_MATERIAL_BITS | FIELD(material, RENDER_KEY_MATERIAL_BITS);
+    key = key << RENDER_KEY_MESH_BITS | FIELD(mesh, RENDER_KEY_MESH_BITS);
+    unsigned long long depthScale = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+    return key << RENDER_KEY_DEPTH_BITS | (unsigned long long)(depth * depthScale);
+}
+
+extern void
+initRenderQueue(struct RenderQueue * queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+extern void
+freeRenderQueue(struct RenderQueue * queue) {
+    free(queue->items);
+    free(queue->scratch);
+    initRenderQueue(queue);
+}
+
+extern void
+clearRenderQueue(struct RenderQueue * queue) {
+    queue->numberOfItems = 0;
+}
+
+extern void
+pushRenderItem(struct RenderQueue * queue, unsigned long long key, unsigned long payload) {
+    if (queue->numberOfItems == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+        size_t size = queue->capacity * sizeof(struct RenderItem);
+        queue->items = erealloc(queue->items, size);
+        queue->scratch = erealloc(queue->scratch, size);
+    }
+    struct RenderItem * item = &queue->items[queue->numberOfItems++];
+    item->key = key;
+    item->payload = payload;
+}
+
+/* A least significant digit radix sort a byte at a time. The histograms of all bytes
+ * are counted in one pass, and a byte that all keys share is skipped, so fields that
+ * do not vary over a frame cost nothing. */
+extern void
+sortRenderQueue(struct RenderQueue * queue) {
+    unsigned long count = queue->numberOfItems;
+    if (count < 2) return;
+    unsigned long histograms[8][256] = { { 0 } };
+    for (unsigned long i = 0; i < count; ++i) {
+        unsigned long long key = queue->items[i].key;
+        for (int byte = 0; byte < 8; ++byte) ++histograms[byte][key >> 8 * byte & 255];
+    }
+    struct RenderItem * from = queue->items;
+    struct RenderItem * to = queue->scratch;
+    for (int byte = 0; byte < 8; ++byte) {
+        unsigned long * histogram = histograms[byte];
+        if (count == histogram[from[0].key >> 8 * byte & 255]) continue;
+        unsigned long offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            unsigned long digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+        for (unsigned long i = 0; i < count; ++i) {
+            to[histogram[from[i].key >> 8 * byte & 255]++] = from[i];
+        }
+        struct RenderItem * sorted = to;
+        to = from;
+        from = sorted;
+    }
+    queue->items = from;
+    queue->scratch = to;
+}
@@ -0,0 +1,34 @@
+/* Draws are sorted by a 64 bit key with these fields, most significant first, so the
+ * queue groups them by the state they need and orders every group front to back. */
+#define RENDER_KEY_PASS_BITS     2
+#define RENDER_KEY_PROGRAM_BITS  8
+#define RENDER_KEY_TEXTURE_BITS  10
+#define RENDER_KEY_MATERIAL_BITS 10
+#define RENDER_KEY_MESH_BITS     10
+#define RENDER_KEY_DEPTH_BITS    24
+
+struct RenderItem {
+    unsigned long long key;
+    unsigned long payload; /* what to draw, up to the caller */
+};
+
+struct RenderQueue {
+    struct RenderItem * items;
+    struct RenderItem * scratch; /* as large as items, for sorting */
+    unsigned long numberOfItems;
+    unsigned long capacity;
+};
+
+/* Fields are cut to their bits, which at worst costs state changes, and depth is
+ * clamped to [0, 1]. */
+extern unsigned long long renderKey(unsigned pass, unsigned program, unsigned texture,
+    unsigned material, unsigned mesh, GLfloat depth);
+
+extern void initRenderQueue(struct RenderQueue * queue);
+extern void freeRenderQueue(struct RenderQueue * queue);
+extern void clearRenderQueue(struct RenderQueue * queue);
+extern void pushRenderItem(struct RenderQueue * queue, unsigned long long key,
+    unsigned long payload);
+
+/* Sorts the items by key, keeping items with equal keys in the order they were pushed. */
+extern void sortRenderQueue(struct RenderQueue * queue);
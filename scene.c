@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include "cpu.h"
+#include "geometry.h"
+#include "scene.h"
+#include "utils.h"
+
+extern void
+initScene(struct Scene * scene) {
+    memset(scene, 0, sizeof(*scene));
+}
+
+extern void
+freeScene(struct Scene * scene) {
+    free(scene->parents);
+    for (int i = 0; i < 3; ++i) {
+        free(scene->translation[i]);
+        free(scene->angles[i]);
+        free(scene->scale[i]);
+    }
+    free(scene->worlds);
+    free(scene->kinds);
+    free(scene->dirty);
+    initScene(scene);
+}
+
+static void
+growScene(struct Scene * scene) {
+    unsigned long capacity = scene->capacity ? scene->capacity * 2 : 64;
+    scene->parents = erealloc(scene->parents, capacity * sizeof(unsigned long));
+    for (int i = 0; i < 3; ++i) {
+        scene->translation[i] = erealloc(scene->translation[i], capacity * sizeof(GLfloat));
+        scene->angles[i] = erealloc(scene->angles[i], capacity * sizeof(GLfloat));
+        scene->scale[i] = erealloc(scene->scale[i], capacity * sizeof(GLfloat));
+    }
+    scene->worlds = erealloc(scene->worlds, capacity * sizeof(Mat4));
+    scene->kinds = erealloc(scene->kinds, capacity * sizeof(enum TransformKind));
+    scene->dirty = erealloc(scene->dirty, capacity);
+    scene->capacity = capacity;
+}
+
+/* A node can only be added under an existing one, which keeps parents first. */
+extern unsigned long
+addSceneNode(struct Scene * scene, unsigned long parent) {
+    if (NO_PARENT != parent && scene->numberOfNodes <= parent) exit(1);
+    if (scene->numberOfNodes == scene->capacity) growScene(scene);
+    unsigned long node = scene->numberOfNodes++;
+    scene->parents[node] = parent;
+    for (int i = 0; i < 3; ++i) {
+        scene->translation[i][node] = 0;
+        scene->angles[i][node] = 0;
+        scene->scale[i][node] = 1;
+    }
+    /* firstDirty is at most the old numberOfNodes, which is node */
+    scene->dirty[node] = 1;
+    return node;
+}
+
+extern void
+setSceneNodeTransform(struct Scene * scene, unsigned long node,
+        const GLfloat * translation, const GLfloat * angles, const GLfloat * scale) {
+    for (int i = 0; i < 3; ++i) {
+        scene->translation[i][node] = translation[i];
+        scene->angles[i][node] = angles[i];
+        scene->scale[i][node] = scale[i];
+    }
+    scene->dirty[node] = 1;
+    if (node < scene->firstDirty) scene->firstDirty = node;
+}
+
+/* A node is recomputed if it or its parent is dirty, and is then dirty itself for its
+ * children further on. The flags are cleared once the pass is through. */
+extern void
+updateScene(struct Scene * scene) {
+    unsigned long first = scene->firstDirty;
+    if (scene->numberOfNodes <= first) return;
+    for (unsigned long i = first; i < scene->numberOfNodes; ++i) {
+        unsigned long parent = scene->parents[i];
+        if (NO_PARENT != parent && scene->dirty[parent]) scene->dirty[i] = 1;
+        if (!scene->dirty[i]) continue;
+        GLfloat translation[3], angles[3], scale[3];
+        for (int j = 0; j < 3; ++j) {
+            translation[j] = scene->translation[j][i];
+            angles[j] = scene->angles[j][i];
+            scale[j] = scene->scale[j][i];
+        }
+        enum TransformKind kind = mat4OfTrs(&scene->worlds[i], translation, angles, scale);
+        if (NO_PARENT != parent) {
+            Mat4 * world = &scene->worlds[i];
+            mat4MultiplyAffine(world, &scene->worlds[parent], world);
+            if (kind < scene->kinds[parent]) kind = scene->kinds[parent];
+        }
+        scene->kinds[i] = kind;
+    }
+    memset(scene->dirty + first, 0, scene->numberOfNodes - first);
+    scene->firstDirty = scene->numberOfNodes;
+}
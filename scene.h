@@ -0,0 +1,29 @@
+#define NO_PARENT ((unsigned long)-1)
+
+/* A transform hierarchy as one array per node property, indexed by node. Parents come
+ * before their children, so world matrices update in one pass from the first dirty node
+ * on, and a scene where nothing moved costs nothing. */
+struct Scene {
+    unsigned long numberOfNodes;
+    unsigned long capacity;
+    unsigned long * parents;     /* NO_PARENT for roots */
+    GLfloat * translation[3];
+    GLfloat * angles[3];         /* as for mat4OfTrs */
+    GLfloat * scale[3];
+    Mat4 * worlds;
+    enum TransformKind * kinds;  /* of the world matrices */
+    unsigned char * dirty;       /* the local transform changed since the last update */
+    unsigned long firstDirty;    /* numberOfNodes if none is dirty */
+};
+
+extern void initScene(struct Scene * scene);
+extern void freeScene(struct Scene * scene);
+
+/* Adds a node with an identity transform under parent, returns its index. */
+extern unsigned long addSceneNode(struct Scene * scene, unsigned long parent);
+
+extern void setSceneNodeTransform(struct Scene * scene, unsigned long node,
+    const GLfloat * translation, const GLfloat * angles, const GLfloat * scale);
+
+/* Recomputes the world matrices of the dirty nodes and their descendants. */
+extern void updateScene(struct Scene * scene);
@@ -7,17 +7,22 @@ struct Material {
     float shininess;
 };
 
-uniform Material material;
 uniform sampler2D tex;
 
 in vec3 normal;
 in vec3 toLight;
 in vec3 toCamera;
 in vec2 texcoords;
+flat in vec3 materialAmbient;
+flat in vec3 materialDiffuse;
+flat in vec3 materialSpecular;
+flat in float materialShininess;
 
 out vec4 resultingColor;
 
 Material light = Material(vec3(1, 1, 1), vec3(1, 1, 1), vec3(1, 1, 1), 0);
+// of the instance, set in main
+Material material;
 
 // returns intensity of reflected ambient lighting
 vec3 ambientLighting() {
@@ -46,6 +51,8 @@ vec3 specularLighting(in vec3 N, in vec3 L, in vec3 V) {
 }
 
 void main(void) {
+   material = Material(materialAmbient, materialDiffuse, materialSpecular,
+      materialShininess);
    // normalize vectors after interpolation
    vec3 L = normalize(toLight);
    vec3 V = normalize(toCamera);
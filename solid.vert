@@ -1,9 +1,18 @@
 #version 330 core
 
-uniform mat4 modelViewInverseTranspose;
-uniform mat4 modelView;
-uniform mat4 projection;
-uniform vec3 lightPos;
+// written once per frame, see struct FrameUniforms in main.c
+layout (std140) uniform Frame {
+    mat4 projection;
+    vec3 lightPos;
+};
+
+// one range of the uniform ring per draw, see struct DrawUniforms in main.c
+layout (std140) uniform Draw {
+    int firstInstance;
+};
+
+// ten texels per instance, see struct Instance in main.c
+uniform samplerBuffer instances;
 
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexTextureCoordiante;
@@ -13,12 +22,27 @@ out vec3 normal;
 out vec3 toLight;
 out vec3 toCamera;
 out vec2 texcoords;
+flat out vec3 materialAmbient;
+flat out vec3 materialDiffuse;
+flat out vec3 materialSpecular;
+flat out float materialShininess;
 
 void main() {
+    // the instance of this vertex
+    int texel = firstInstance + gl_InstanceID * 10;
+    mat4 modelView = mat4(texelFetch(instances, texel), texelFetch(instances, texel + 1),
+        texelFetch(instances, texel + 2), texelFetch(instances, texel + 3));
+    mat3 normalMatrix = mat3(texelFetch(instances, texel + 4).xyz,
+        texelFetch(instances, texel + 5).xyz, texelFetch(instances, texel + 6).xyz);
+    materialAmbient = texelFetch(instances, texel + 7).xyz;
+    materialDiffuse = texelFetch(instances, texel + 8).xyz;
+    vec4 specular = texelFetch(instances, texel + 9);
+    materialSpecular = specular.xyz;
+    materialShininess = specular.w;
     // position in world space
     vec4 worldPosition = modelView * vec4(vertexPosition, 1);
     // normal in world space
-    normal = normalize(modelViewInverseTranspose * vec4(vertexNormal, 1)).xyz;
+    normal = normalize(normalMatrix * vertexNormal);
     // direction to light
     toLight = normalize(lightPos - worldPosition.xyz);
     // direction to camera
@@ -0,0 +1,409 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "cpu.h"
+#include "texture.h"
+#include "utils.h"
+
+/* A texture cache holds the image with its full mip chain compressed to BC1 (DXT1, 
+ * 4 bits per texel against 24 for RGB8), so loading it is a matter of mapping the file 
+ * and handing every level to glCompressedTexImage2D. Levels follow the header tightly 
+ * packed, largest first. Without EXT_texture_compression_s3tc, which GL 3.3 core does 
+ * not guarantee, the cache is ignored and the source image loaded instead. */
+#define TEXTURE_CACHE_MAGIC   0x48435854
+#define TEXTURE_CACHE_VERSION 2
+
+struct TextureCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    struct FileStamp source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numberOfLevels;
+    uint32_t padding;
+};
+
+static uint32_t
+sizeOfLevel(uint32_t size, uint32_t level) {
+    size >>= level;
+    return size ? size : 1;
+}
+
+/* BC1 stores every 4x4 block of texels in 8 bytes, partial blocks included. */
+static size_t
+compressedSizeOfLevel(uint32_t width, uint32_t height) {
+    return 8 * (((size_t)width + 3) / 4) * (((size_t)height + 3) / 4);
+}
+
+/* Uploads the levels of a cache read into content to the bound texture. Returns 
+ * nonzero without touching the texture if content is no up to date cache of the 
+ * image at filepath. */
+static int
+uploadTextureCache(char * filepath, char * content, size_t contentSize) {
+    struct FileStamp source;
+    struct TextureCacheHeader header;
+    if (!GLEW_EXT_texture_compression_s3tc || contentSize < sizeof(header) 
+            || stampFile(filepath, &source, 0)) return 1;
+    memcpy(&header, content, sizeof(header));
+    uint64_t size = sizeof(header);
+    for (uint32_t level = 0; level < header.numberOfLevels && level < 32; ++level) {
+        size += compressedSizeOfLevel(sizeOfLevel(header.width, level), 
+            sizeOfLevel(header.height, level));
+    }
+    if (TEXTURE_CACHE_MAGIC != header.magic || TEXTURE_CACHE_VERSION != header.version
+            || source.size != header.source.size 
+            || source.modificationTime != header.source.modificationTime
+            || !header.numberOfLevels || 32 < header.numberOfLevels
+            || (uint64_t)contentSize < size) return 1;
+    char * data = content + sizeof(header);
+    for (uint32_t level = 0; level < header.numberOfLevels; ++level) {
+        uint32_t width = sizeOfLevel(header.width, level);
+        uint32_t height = sizeOfLevel(header.height, level);
+        size_t levelSize = compressedSizeOfLevel(width, height);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 
+            width, height, 0, levelSize, data);
+        data += levelSize;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.numberOfLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    return 0;
+}
+
+/* Returns nonzero without touching the bound texture if there is no up to date cache. */
+static int
+loadTextureCache(char * filepath) {
+    struct FileStamp cache;
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    if (stampFile(cachePath, &cache, 0)) {
+        free(cachePath);
+        return 1;
+    }
+    size_t mappingSize;
+    char * mapping = mapFile(cachePath, &mappingSize);
+    free(cachePath);
+    int failed = uploadTextureCache(filepath, mapping, cache.size);
+    unmapFile(mapping, mappingSize);
+    return failed;
+}
+
+static void
+uploadImage(unsigned char * data, int width, int height) {
+    if (!data) exit(1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    stbi_image_free(data);
+}
+
+static GLuint
+createTexture(void) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    return texture;
+}
+
+extern GLuint
+loadTexture(char * filepath) {
+    GLuint texture = createTexture();
+    if (!loadTextureCache(filepath)) return texture;
+    int width, height, channels;
+    unsigned char * data = stbi_load(filepath, &width, &height, &channels, 3);
+    uploadImage(data, width, height);
+    return texture;
+}
+
+/* Names the file loadTexture would read for an image, its cache if there is one, so 
+ * the file can be read ahead of time. */
+extern char *
+textureFileOf(char * filepath) {
+    struct FileStamp cache;
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    if (!stampFile(cachePath, &cache, 0)) return cachePath;
+    free(cachePath);
+    return pathWithSuffix(filepath, "");
+}
+
+/* Creates the texture of an image from the content of the file textureFileOf named. 
+ * A cache that turns out to be out of date is ignored and the image loaded instead. */
+extern GLuint
+createTextureFromFile(char * filepath, char * content, size_t size) {
+    GLuint texture = createTexture();
+    if (!uploadTextureCache(filepath, content, size)) return texture;
+    int width, height, channels;
+    unsigned char * data;
+    uint32_t magic = 0;
+    if (sizeof(magic) <= size) memcpy(&magic, content, sizeof(magic));
+    if (TEXTURE_CACHE_MAGIC == magic) {
+        data = stbi_load(filepath, &width, &height, &channels, 3);
+    } else {
+        data = stbi_load_from_memory((unsigned char *)content, size, 
+            &width, &height, &channels, 3);
+    }
+    uploadImage(data, width, height);
+    return texture;
+}
+
+/* Adds two rows of a level byte by byte, the vertical half of the box filter. */
+static void
+sumRowsScalar(uint16_t * sums, const unsigned char * row0, const unsigned char * row1, 
+        size_t size) {
+    for (size_t i = 0; i < size; ++i) sums[i] = row0[i] + row1[i];
+}
+
+#ifdef CPU_X86
+
+static CPU_TARGET_SSE void
+sumRowsSse(uint16_t * sums, const unsigned char * row0, const unsigned char * row1, 
+        size_t size) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(row0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(row1 + i));
+        _mm_storeu_si128((__m128i *)(sums + i), 
+            _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+        _mm_storeu_si128((__m128i *)(sums + i + 8), 
+            _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+    }
+    sumRowsScalar(sums + i, row0 + i, row1 + i, size - i);
+}
+
+static CPU_TARGET_AVX2 void
+sumRowsAvx2(uint16_t * sums, const unsigned char * row0, const unsigned char * row1, 
+        size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row0 + i)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row1 + i)));
+        _mm256_storeu_si256((__m256i *)(sums + i), _mm256_add_epi16(a, b));
+    }
+    sumRowsScalar(sums + i, row0 + i, row1 + i, size - i);
+}
+
+static CPU_TARGET_AVX512 void
+sumRowsAvx512(uint16_t * sums, const unsigned char * row0, const unsigned char * row1, 
+        size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(row0 + i)));
+        __m512i b = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(row1 + i)));
+        _mm512_storeu_si512((void *)(sums + i), _mm512_add_epi16(a, b));
+    }
+    sumRowsScalar(sums + i, row0 + i, row1 + i, size - i);
+}
+
+#endif
+
+/* Bound at startup by bindTextureKernels */
+static void (*sumRows)(uint16_t * sums, const unsigned char * row0, 
+    const unsigned char * row1, size_t size) = sumRowsScalar;
+
+static void
+bindTextureKernels(enum CpuLevel level) {
+    sumRows = sumRowsScalar;
+#ifdef CPU_X86
+    if (CPU_SSE <= level) sumRows = sumRowsSse;
+    if (CPU_AVX2 <= level) sumRows = sumRowsAvx2;
+    if (CPU_AVX512 <= level) sumRows = sumRowsAvx512;
+#else
+    (void)level;
+#endif
+}
+
+static void __attribute__((constructor))
+bindTextureKernelsAtStartup(void) {
+    bindTextureKernels(cpuLevel());
+}
+
+/* Box filters every 2x2 block of the level into one texel of the next level. Odd 
+ * sizes repeat their last row or column. */
+static unsigned char *
+downsample(unsigned char * in, uint32_t width, uint32_t height) {
+    uint32_t outWidth = sizeOfLevel(width, 1), outHeight = sizeOfLevel(height, 1);
+    unsigned char * out = emalloc(3 * (size_t)outWidth * outHeight);
+    uint16_t * sums = emalloc(3 * (size_t)width * sizeof(uint16_t));
+    for (uint32_t y = 0; y < outHeight; ++y) {
+        uint32_t y0 = 2 * y, y1 = y0 + 1 < height ? y0 + 1 : y0;
+        sumRows(sums, in + 3 * (size_t)y0 * width, in + 3 * (size_t)y1 * width, 
+            3 * (size_t)width);
+        for (uint32_t x = 0; x < outWidth; ++x) {
+            uint32_t x0 = 2 * x, x1 = x0 + 1 < width ? x0 + 1 : x0;
+            for (int c = 0; c < 3; ++c) {
+                unsigned sum = sums[3 * x0 + c] + sums[3 * x1 + c];
+                out[3 * ((size_t)y * outWidth + x) + c] = (sum + 2) / 4;
+            }
+        }
+    }
+    free(sums);
+    return out;
+}
+
+/* Packs a color into a 5:6:5 BC1 endpoint and back. */
+static uint16_t
+packColor(const int * color) {
+    return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 
+        | ((color[1] * 63 + 127) / 255) << 5 | (color[2] * 31 + 127) / 255);
+}
+
+static void
+unpackColor(uint16_t packed, int * color) {
+    color[0] = (packed >> 11 & 31) * 255 / 31;
+    color[1] = (packed >> 5 & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+/* Compresses the 4x4 block at blockX, blockY of a level to 8 bytes of BC1. The 
+ * endpoints are the corners of the bounding box of the block, on the diagonal red and 
+ * blue run along with green, and every texel takes the nearest of the four palette 
+ * colors. Texels past the edge of the level repeat the last row or column. */
+static void
+compressBlock(unsigned char * out, const unsigned char * level, uint32_t width, 
+        uint32_t height, uint32_t blockX, uint32_t blockY) {
+    int texels[16][3], low[3] = {255, 255, 255}, high[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        uint32_t x = 4 * blockX + i % 4, y = 4 * blockY + i / 4;
+        if (width <= x) x = width - 1;
+        if (height <= y) y = height - 1;
+        for (int c = 0; c < 3; ++c) {
+            texels[i][c] = level[3 * ((size_t)y * width + x) + c];
+            if (texels[i][c] < low[c]) low[c] = texels[i][c];
+            if (high[c] < texels[i][c]) high[c] = texels[i][c];
+            mean[c] += texels[i][c];
+        }
+    }
+    long covariance[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; c += 2) {
+            covariance[c] += (long)(16 * texels[i][c] - mean[c]) 
+                * (16 * texels[i][1] - mean[1]);
+        }
+    }
+    for (int c = 0; c < 3; c += 2) {
+        if (covariance[c] < 0) {
+            int swap = low[c];
+            low[c] = high[c];
+            high[c] = swap;
+        }
+    }
+    uint16_t color0 = packColor(high), color1 = packColor(low);
+    if (color0 < color1) {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackColor(color0, palette[0]);
+        unpackColor(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = 3 * 255 * 255 + 1;
+            for (int p = 0; p < 4; ++p) {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int difference = texels[i][c] - palette[p][c];
+                    distance += difference * difference;
+                }
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t)best << 2 * i;
+        }
+    }
+    out[0] = color0 & 255;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 255;
+    out[3] = color1 >> 8;
+    for (int i = 0; i < 4; ++i) out[4 + i] = indices >> 8 * i & 255;
+}
+
+/* Compresses a level block by block into a buffer of compressedSizeOfLevel bytes. */
+static unsigned char *
+compressLevel(const unsigned char * level, uint32_t width, uint32_t height) {
+    unsigned char * out = emalloc(compressedSizeOfLevel(width, height));
+    unsigned char * block = out;
+    for (uint32_t blockY = 0; blockY < (height + 3) / 4; ++blockY) {
+        for (uint32_t blockX = 0; blockX < (width + 3) / 4; ++blockX) {
+            compressBlock(block, level, width, height, blockX, blockY);
+            block += 8;
+        }
+    }
+    return out;
+}
+
+/* Builds the cache of a texture ahead of time. A cache whose content hash still 
+ * matches is only restamped, just like mesh caches. Returns nonzero if the cache was 
+ * already up to date. */
+extern int
+cookTexture(char * filepath) {
+    struct FileStamp source;
+    if (stampFile(filepath, &source, 1)) exit(1);
+    char * cachePath = pathWithSuffix(filepath, ".cache");
+    char * temporaryPath = pathWithSuffix(filepath, ".cache.tmp");
+    FILE * cache = fopen(cachePath, "r+b");
+    struct TextureCacheHeader header;
+    int upToDate = cache && 1 == fread(&header, sizeof(header), 1, cache)
+        && TEXTURE_CACHE_MAGIC == header.magic && TEXTURE_CACHE_VERSION == header.version
+        && source.hash == header.source.hash;
+    if (upToDate) {
+        header.source = source;
+        if (fseek(cache, 0, SEEK_SET) || 1 != fwrite(&header, sizeof(header), 1, cache)) exit(1);
+    }
+    if (cache && fclose(cache)) exit(1);
+    if (!upToDate) {
+        int width, height, channels;
+        unsigned char * level = stbi_load(filepath, &width, &height, &channels, 3);
+        if (!level) exit(1);
+        FILE * out = fopen(temporaryPath, "wb");
+        if (!out) exit(1);
+        header.magic          = TEXTURE_CACHE_MAGIC;
+        header.version        = TEXTURE_CACHE_VERSION;
+        header.source         = source;
+        header.width          = width;
+        header.height         = height;
+        header.numberOfLevels = 1;
+        header.padding        = 0;
+        while (1 < sizeOfLevel(header.width, header.numberOfLevels - 1) 
+                || 1 < sizeOfLevel(header.height, header.numberOfLevels - 1)) {
+            ++header.numberOfLevels;
+        }
+        int failed = 1 != fwrite(&header, sizeof(header), 1, out);
+        for (uint32_t i = 0; i < header.numberOfLevels; ++i) {
+            uint32_t levelWidth = sizeOfLevel(header.width, i);
+            uint32_t levelHeight = sizeOfLevel(header.height, i);
+            size_t size = compressedSizeOfLevel(levelWidth, levelHeight);
+            unsigned char * compressed = compressLevel(level, levelWidth, levelHeight);
+            failed |= size != fwrite(compressed, 1, size, out);
+            free(compressed);
+            unsigned char * next = downsample(level, levelWidth, levelHeight);
+            if (i) free(level);
+            else stbi_image_free(level);
+            level = next;
+        }
+        free(level);
+        failed |= fclose(out);
+        failed |= rename(temporaryPath, cachePath);
+        if (failed) exit(1);
+    }
+    free(cachePath);
+    free(temporaryPath);
+    return upToDate;
+}
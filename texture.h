@@ -0,0 +1,4 @@
+extern GLuint loadTexture(char * filepath);
+extern char * textureFileOf(char * filepath);
+extern GLuint createTextureFromFile(char * filepath, char * content, size_t size);
+extern int cookTexture(char * filepath);
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "uniforms.h"
+
+extern void
+createUniformRing(struct UniformRing * ring, GLsizeiptr blockSize,
+        unsigned long blocksPerFrame) {
+    memset(ring, 0, sizeof(*ring));
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ring->blockSize = (blockSize + alignment - 1) / alignment * alignment;
+    ring->regionSize = ring->blockSize * blocksPerFrame;
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, ring->regionSize * UNIFORM_RING_FRAMES, NULL,
+        GL_STREAM_DRAW);
+}
+
+extern void
+freeUniformRing(struct UniformRing * ring) {
+    for (int i = 0; i < UNIFORM_RING_FRAMES; ++i) {
+        if (ring->fences[i]) glDeleteSync(ring->fences[i]);
+    }
+    glDeleteBuffers(1, &ring->buffer);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* The draws of the previous frame were all issued by now, so its fence goes in here.
+ * The region is mapped unsynchronized, as its fence already tells when it is free. */
+extern void
+beginUniformFrame(struct UniformRing * ring) {
+    if (ring->used) {
+        ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ring->region = (ring->region + 1) % UNIFORM_RING_FRAMES;
+    }
+    GLsync fence = ring->fences[ring->region];
+    if (fence) {
+        while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+            1000000000));
+        glDeleteSync(fence);
+        ring->fences[ring->region] = 0;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    ring->mapping = glMapBufferRange(GL_UNIFORM_BUFFER, ring->region * ring->regionSize,
+        ring->regionSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+        GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!ring->mapping) exit(1);
+    ring->used = 0;
+}
+
+extern void
+endUniformFrame(struct UniformRing * ring) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    ring->mapping = NULL;
+}
+
+extern void *
+reserveUniforms(struct UniformRing * ring, GLsizeiptr size, GLintptr * offset) {
+    if (ring->blockSize < size || ring->regionSize < ring->used + ring->blockSize) exit(1);
+    void * block = ring->mapping + ring->used;
+    *offset = ring->region * ring->regionSize + ring->used;
+    ring->used += ring->blockSize;
+    return block;
+}
+
+extern GLintptr
+pushUniforms(struct UniformRing * ring, const void * block, GLsizeiptr size) {
+    GLintptr offset;
+    memcpy(reserveUniforms(ring, size, &offset), block, size);
+    return offset;
+}
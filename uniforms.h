@@ -0,0 +1,29 @@
+#define UNIFORM_RING_FRAMES 3
+
+/* A uniform buffer with one region per frame in flight. A frame maps its region once,
+ * appends its blocks and unmaps it before drawing, so every draw only binds a range.
+ * A fence per region keeps a frame from writing what the GPU may still read. */
+struct UniformRing {
+    GLuint buffer;
+    GLsizeiptr blockSize;    /* padded to the offset alignment of uniform buffers */
+    GLsizeiptr regionSize;
+    unsigned region;
+    GLsync fences[UNIFORM_RING_FRAMES];
+    char * mapping;          /* of the current region, NULL outside a frame */
+    GLsizeiptr used;         /* bytes of the current region */
+};
+
+/* Makes room for blocksPerFrame blocks of at most blockSize bytes each frame. */
+extern void createUniformRing(struct UniformRing * ring, GLsizeiptr blockSize,
+    unsigned long blocksPerFrame);
+extern void freeUniformRing(struct UniformRing * ring);
+
+extern void beginUniformFrame(struct UniformRing * ring);
+extern void endUniformFrame(struct UniformRing * ring);
+
+/* Takes a block of the current frame to be written through the returned pointer, and
+ * stores its offset in ring->buffer to offset. */
+extern void * reserveUniforms(struct UniformRing * ring, GLsizeiptr size, GLintptr * offset);
+
+/* Copies a block into the current frame and returns its offset in ring->buffer. */
+extern GLintptr pushUniforms(struct UniformRing * ring, const void * block, GLsizeiptr size);
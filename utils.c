@@ -1,5 +1,16 @@
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "assetpack.h"
 
 extern void * 
 emalloc(size_t size) {
@@ -8,11 +19,29 @@ emalloc(size_t size) {
     return p;
 }
 
+extern void *
+erealloc(void * p, size_t size) {
+    p = realloc(p, size);
+    if (!p) exit(1);
+    return p;
+}
+
 #define KILOBYTE 1024
 #define MEGABYTE (1024 * KILOBYTE)
 
 extern char *
 loadFile(const char * filepath) {
+    struct FileStamp stamp;
+    if (!stampPackedFile(filepath, &stamp)) {
+        if (4 * MEGABYTE < stamp.size) exit(1);
+        size_t mappingSize;
+        char * mapping = mapPackedFile(filepath, &mappingSize);
+        char * string = emalloc(stamp.size + 1);
+        memcpy(string, mapping, stamp.size);
+        string[stamp.size] = 0;
+        unmapFile(mapping, mappingSize);
+        return string;
+    }
     FILE * f = fopen(filepath, "rb");
     if (!f) exit(1);
     if (-1 == fseek(f, 0, SEEK_END)) exit(1);
@@ -26,3 +55,167 @@ loadFile(const char * filepath) {
     string[fileSize] = 0;
     return string;
 }
+
+extern char *
+pathWithSuffix(const char * filepath, const char * suffix) {
+    char * path = emalloc(strlen(filepath) + strlen(suffix) + 1);
+    strcpy(path, filepath);
+    strcat(path, suffix);
+    return path;
+}
+
+/* Maps the file read-only instead of reading it, so its pages are backed by the page
+ * cache and can be evicted under memory pressure. The mapping always ends with at
+ * least one zero byte, so it can be parsed as a string just like loadFile output. */
+extern char *
+mapFile(const char * filepath, size_t * mappingSize) {
+    char * packed = mapPackedFile(filepath, mappingSize);
+    if (packed) return packed;
+    int fd = open(filepath, O_RDONLY);
+    if (-1 == fd) exit(1);
+    struct stat status;
+    if (-1 == fstat(fd, &status)) exit(1);
+    size_t fileSize = status.st_size;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    *mappingSize = (fileSize / pageSize + 1) * pageSize;
+    char * mapping = mmap(NULL, *mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mapping) exit(1);
+    if (fileSize && MAP_FAILED == mmap(mapping, fileSize, PROT_READ, 
+                MAP_PRIVATE | MAP_FIXED, fd, 0)) exit(1);
+    close(fd);
+    return mapping;
+}
+
+extern void
+unmapFile(char * mapping, size_t mappingSize) {
+    munmap(mapping, mappingSize);
+}
+
+/* Drops the whole pages of a mapping that lie before offset. Pages mapped from a file
+ * would be paged back in if read again, but packed files may sit in anonymous memory,
+ * whose pages come back as zeros, so callers must never read a dropped range again.
+ * Returns the number of bytes dropped. */
+extern size_t
+discardMappedPages(char * mapping, size_t offset) {
+    size_t size = offset - offset % sysconf(_SC_PAGESIZE);
+    if (!size || madvise(mapping, size, MADV_DONTNEED)) return 0;
+    return size;
+}
+
+/* parallelFor runs on a pool of worker threads, one per online processor besides the
+ * caller, started on first use and kept for the life of the process, so per frame 
+ * kernels do not pay for creating threads. Calls queue a job of one task per 
+ * processor. Callers run tasks of their own job too, so a job finishes even if every 
+ * worker is busy with other callers, or if a task itself calls parallelFor. */
+struct ParallelJob {
+    void (*body)(void * context, unsigned long begin, unsigned long end);
+    void * context;
+    unsigned long count;
+    unsigned long numberOfTasks;
+    unsigned long numberOfClaimed;
+    unsigned long numberOfFinished;
+    pthread_cond_t finished;
+    struct ParallelJob * next;
+};
+
+static pthread_once_t workersStarted = PTHREAD_ONCE_INIT;
+static pthread_mutex_t workerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobQueued = PTHREAD_COND_INITIALIZER;
+static struct ParallelJob * queuedJobs; /* with tasks left to claim, oldest first */
+static unsigned long numberOfProcessors;
+
+/* With workerLock held, takes the next task of job and runs it unlocked. */
+static void
+runParallelTask(struct ParallelJob * job) {
+    unsigned long task = job->numberOfClaimed++;
+    if (job->numberOfClaimed == job->numberOfTasks) {
+        struct ParallelJob ** link = &queuedJobs;
+        while (*link != job) link = &(*link)->next;
+        *link = job->next;
+    }
+    pthread_mutex_unlock(&workerLock);
+    unsigned long share = job->count / job->numberOfTasks;
+    unsigned long extra = job->count % job->numberOfTasks;
+    unsigned long begin = task * share + (task < extra ? task : extra);
+    job->body(job->context, begin, begin + share + (task < extra));
+    pthread_mutex_lock(&workerLock);
+    if (++job->numberOfFinished == job->numberOfTasks) pthread_cond_signal(&job->finished);
+}
+
+static void *
+runWorker(void * argument) {
+    (void)argument;
+    pthread_mutex_lock(&workerLock);
+    for (;;) {
+        while (!queuedJobs) pthread_cond_wait(&jobQueued, &workerLock);
+        runParallelTask(queuedJobs);
+    }
+    return NULL;
+}
+
+static void
+startWorkers(void) {
+    long numberOfOnline = sysconf(_SC_NPROCESSORS_ONLN);
+    numberOfProcessors = 0 < numberOfOnline ? numberOfOnline : 1;
+    for (unsigned long i = 1; i < numberOfProcessors; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, runWorker, NULL)) exit(1);
+        pthread_detach(thread);
+    }
+}
+
+/* Splits [0, count) into one contiguous range per online processor and runs body on 
+ * all of them in parallel. */
+extern void
+parallelFor(unsigned long count, 
+        void (*body)(void * context, unsigned long begin, unsigned long end), void * context) {
+    if (!count) return;
+    pthread_once(&workersStarted, startWorkers);
+    unsigned long numberOfTasks = numberOfProcessors;
+    if (count < numberOfTasks) numberOfTasks = count;
+    if (1 == numberOfTasks) {
+        body(context, 0, count);
+        return;
+    }
+    struct ParallelJob job = {
+        .body = body,
+        .context = context,
+        .count = count,
+        .numberOfTasks = numberOfTasks,
+    };
+    pthread_cond_init(&job.finished, NULL);
+    pthread_mutex_lock(&workerLock);
+    struct ParallelJob ** link = &queuedJobs;
+    while (*link) link = &(*link)->next;
+    *link = &job;
+    pthread_cond_broadcast(&jobQueued);
+    while (job.numberOfClaimed < job.numberOfTasks) runParallelTask(&job);
+    while (job.numberOfFinished < job.numberOfTasks) {
+        pthread_cond_wait(&job.finished, &workerLock);
+    }
+    pthread_mutex_unlock(&workerLock);
+    pthread_cond_destroy(&job.finished);
+}
+
+/* Returns nonzero if the file does not exist. Hashing reads the whole file, so callers
+ * at runtime only compare size and modification time. */
+extern int
+stampFile(const char * filepath, struct FileStamp * stamp, int hashContent) {
+    struct stat status;
+    stamp->hash = 0;
+    if (stampPackedFile(filepath, stamp)) {
+        if (stat(filepath, &status)) return 1;
+        stamp->size = status.st_size;
+        stamp->modificationTime = status.st_mtime;
+    }
+    if (hashContent) {
+        size_t mappingSize;
+        unsigned char * content = (unsigned char *)mapFile(filepath, &mappingSize);
+        stamp->hash = 14695981039346656037ULL;
+        for (unsigned long long i = 0; i < stamp->size; ++i) {
+            stamp->hash = (stamp->hash ^ content[i]) * 1099511628211ULL;
+        }
+        unmapFile((char *)content, mappingSize);
+    }
+    return 0;
+}
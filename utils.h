@@ -1,3 +1,18 @@
 extern void * emalloc(size_t size);
+extern void * erealloc(void * p, size_t size);
 extern char * loadFile(const char * filepath);
+extern char * pathWithSuffix(const char * filepath, const char * suffix);
+extern char * mapFile(const char * filepath, size_t * mappingSize);
+extern void unmapFile(char * mapping, size_t mappingSize);
+extern size_t discardMappedPages(char * mapping, size_t offset);
+extern void parallelFor(unsigned long count, 
+    void (*body)(void * context, unsigned long begin, unsigned long end), void * context);
 
+/* Identifies the version of a source file a cache was built from. */
+struct FileStamp {
+    unsigned long long size;
+    long long modificationTime;
+    unsigned long long hash; /* FNV-1a of the content, 0 when not computed */
+};
+
+extern int stampFile(const char * filepath, struct FileStamp * stamp, int hashContent);